@@ -0,0 +1,158 @@
+
+#include "ExrWriter.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// See "Reading and Writing OpenEXR Image Files" and the OpenEXR file layout documentation: magic number and version,
+// header attributes ending with a null byte, offset table of the scanline blocks, then the blocks. Without compression
+// a block is a single scanline holding the samples of each channel in turn, channels being sorted by name.
+
+namespace
+{
+
+	void Append(std::vector<unsigned char>& bytes, const void* data, size_t size)
+	{
+		bytes.insert(bytes.end(), (const unsigned char*)data, (const unsigned char*)data + size);
+	}
+
+	void AppendInt(std::vector<unsigned char>& bytes, int32_t value)
+	{
+		Append(bytes, &value, sizeof(value));
+	}
+
+	void AppendFloat(std::vector<unsigned char>& bytes, float value)
+	{
+		Append(bytes, &value, sizeof(value));
+	}
+
+	void AppendAttribute(std::vector<unsigned char>& bytes, const char* name, const char* type, const std::vector<unsigned char>& value)
+	{
+		Append(bytes, name, strlen(name) + 1);
+		Append(bytes, type, strlen(type) + 1);
+		AppendInt(bytes, int32_t(value.size()));
+		Append(bytes, value.data(), value.size());
+	}
+
+	// Names of the channels sorted as in the file and the index of each one in the interleaved pixels
+	const char* const ChannelNames[4] = { "A", "B", "G", "R" };
+	const int ChannelIndices[4] = { 3, 2, 1, 0 };
+
+}
+
+bool ExrWriter::Begin(const char* fileName, int width, int height, int channelCount, PixelType pixelType)
+{
+	if (channelCount != 1 && channelCount != 4)
+		return false;
+	mFile = fopen(fileName, "wb");
+	if (!mFile)
+		return false;
+	mWidth = width;
+	mHeight = height;
+	mChannelCount = channelCount;
+	mPixelType = pixelType;
+	mNextRow = 0;
+
+	std::vector<unsigned char> header;
+	AppendInt(header, 20000630);		// magic number
+	AppendInt(header, 2);				// version 2, single part scanline image
+
+	std::vector<unsigned char> value;
+	for (int c = 0; c < channelCount; c++)
+	{
+		const char* name = channelCount == 1 ? "Y" : ChannelNames[c];
+		Append(value, name, strlen(name) + 1);
+		AppendInt(value, int32_t(pixelType));
+		AppendInt(value, 0);			// pLinear and reserved
+		AppendInt(value, 1);			// x and y sampling
+		AppendInt(value, 1);
+	}
+	value.push_back(0);
+	AppendAttribute(header, "channels", "chlist", value);
+
+	value.assign(1, 0);					// NO_COMPRESSION
+	AppendAttribute(header, "compression", "compression", value);
+
+	value.clear();
+	AppendInt(value, 0);
+	AppendInt(value, 0);
+	AppendInt(value, width - 1);
+	AppendInt(value, height - 1);
+	AppendAttribute(header, "dataWindow", "box2i", value);
+	AppendAttribute(header, "displayWindow", "box2i", value);
+
+	value.assign(1, 0);					// INCREASING_Y
+	AppendAttribute(header, "lineOrder", "lineOrder", value);
+
+	value.clear();
+	AppendFloat(value, 1.0f);
+	AppendAttribute(header, "pixelAspectRatio", "float", value);
+
+	value.clear();
+	AppendFloat(value, 0.0f);
+	AppendFloat(value, 0.0f);
+	AppendAttribute(header, "screenWindowCenter", "v2f", value);
+
+	value.clear();
+	AppendFloat(value, 1.0f);
+	AppendAttribute(header, "screenWindowWidth", "float", value);
+	header.push_back(0);
+
+	// Scanlines all have the same size without compression, so the offset table is known upfront
+	const uint64_t blockSize = 8 + uint64_t(width) * channelCount * (pixelType == PixelType::Half ? 2 : 4);
+	const uint64_t firstBlock = header.size() + sizeof(uint64_t) * height;
+	for (int y = 0; y < height; y++)
+	{
+		const uint64_t offset = firstBlock + blockSize * y;
+		Append(header, &offset, sizeof(offset));
+	}
+
+	if (fwrite(header.data(), header.size(), 1, mFile) != 1)
+	{
+		fclose(mFile);
+		mFile = nullptr;
+		return false;
+	}
+	return true;
+}
+
+bool ExrWriter::WriteRows(int rowCount, const void* pixels)
+{
+	if (!mFile || mNextRow + rowCount > mHeight)
+		return false;
+
+	// Deinterleave the channels of all the rows, then write them at once
+	const size_t sampleSize = mPixelType == PixelType::Half ? 2 : 4;
+	const size_t rowSamples = size_t(mWidth) * mChannelCount;
+	std::vector<unsigned char> blocks((8 + rowSamples * sampleSize) * rowCount);
+	unsigned char* dst = blocks.data();
+	for (int row = 0; row < rowCount; row++)
+	{
+		const int32_t y = mNextRow + row;
+		const int32_t dataSize = int32_t(rowSamples * sampleSize);
+		memcpy(dst, &y, 4);
+		memcpy(dst + 4, &dataSize, 4);
+		dst += 8;
+
+		const unsigned char* src = (const unsigned char*)pixels + row * rowSamples * sampleSize;
+		for (int c = 0; c < mChannelCount; c++)
+		{
+			const int channel = mChannelCount == 1 ? 0 : ChannelIndices[c];
+			for (int x = 0; x < mWidth; x++, dst += sampleSize)
+				memcpy(dst, src + (size_t(x) * mChannelCount + channel) * sampleSize, sampleSize);
+		}
+	}
+	mNextRow += rowCount;
+	return fwrite(blocks.data(), blocks.size(), 1, mFile) == 1;
+}
+
+bool ExrWriter::End()
+{
+	if (!mFile)
+		return false;
+	const bool complete = mNextRow == mHeight;
+	const bool closed = fclose(mFile) == 0;
+	mFile = nullptr;
+	return complete && closed;
+}
@@ -0,0 +1,44 @@
+#ifndef D_EXRWRITER
+#define D_EXRWRITER
+
+#include <stdio.h>
+
+///
+/// Writes uncompressed OpenEXR scanline images of half or float channels, progressively like tga_write_raw_begin:
+/// Begin() writes the header and the scanline offset table, the rows are then passed in order over any number of
+/// WriteRows() calls, and End() closes the file. One channel images use the luminance channel Y, four channel ones
+/// R, G, B and A. Scanline 0 is the top of the image. Little endian only.
+///
+class ExrWriter
+{
+public:
+
+	enum class PixelType
+	{
+		Half = 1,
+		Float = 2,
+	};
+
+	ExrWriter() : mFile(nullptr), mWidth(0), mHeight(0), mChannelCount(0), mPixelType(PixelType::Float), mNextRow(0) {}
+
+	/// @param channelCount 1 or 4.
+	/// @return false if the file cannot be created.
+	bool Begin(const char* fileName, int width, int height, int channelCount, PixelType pixelType);
+
+	/// Appends rowCount rows of width pixels, channels being interleaved (RGBA order) as in a TGA image.
+	bool WriteRows(int rowCount, const void* pixels);
+
+	/// @return false if fewer rows than the height were written or the file could not be completed.
+	bool End();
+
+private:
+
+	FILE* mFile;
+	int mWidth;
+	int mHeight;
+	int mChannelCount;
+	PixelType mPixelType;
+	int mNextRow;
+};
+
+#endif // D_EXRWRITER
@@ -0,0 +1,937 @@
+
+#include "NoiseChannelGraph.h"
+#include "TileableVolumeNoise.h"
+#include "VolumeMips.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace
+{
+
+	// Estimated nanoseconds per voxel of a noise reused from another volume and of an instruction of the channel program
+	const float SharedNoiseCost = 1.0f;
+	const float InstructionCost = 2.0f;
+
+	// Slowdown of the batched Worley and Perlin kernels of each backend relative to AVX-512, measured on one core with
+	// 128^3 voxel batches. Indexed by Tileable3dNoise::Backend.
+	const float WorleyBackendFactors[] = { 8.0f, 3.0f, 1.5f, 1.0f };
+	const float PerlinBackendFactors[] = { 4.0f, 1.7f, 1.3f, 1.0f };
+
+	// Nanoseconds below which the scheduling overhead of a task is not negligible
+	const double MinTaskCost = 20000.0;
+
+	// Voxels below which bricks are not halved further, whatever the task cost. Keeps the rows and batches of the
+	// kernels long enough to amortize their setup.
+	const double MinBrickVoxelCount = 4096.0;
+
+	// Average values replacing band limited noise nodes, the one of the inverted Worley noise being measured for cell
+	// counts from 4 to 32 over several seeds
+	const float PerlinAverage = 0.5f;
+	const float WorleyAverage = 0.71f;
+
+	// Ordered dithering threshold in ]0, 1[ of a voxel: 4x4 Bayer matrix in each slice, offset by a quarter of a level
+	// step from one slice to the next. Tiles volumes whose size is a multiple of 4.
+	float DitherThreshold(int s, int t, int r)
+	{
+		static const int bayer[4][4] = { { 0, 8, 2, 10 }, { 12, 4, 14, 6 }, { 3, 11, 1, 9 }, { 15, 7, 13, 5 } };
+		static const int sliceOffset[4] = { 0, 2, 1, 3 };
+		return (float(bayer[t & 3][s & 3] * 4 + sliceOffset[r & 3]) + 0.5f) / 64.0f;
+	}
+
+	bool ParseNumber(const std::string& token, float& value)
+	{
+		char* end = nullptr;
+		value = strtof(token.c_str(), &end);
+		return !token.empty() && *end == 0;
+	}
+
+	bool IsIdentifier(const std::string& token)
+	{
+		if (token.empty() || !(isalpha((unsigned char)token[0]) || token[0] == '_'))
+			return false;
+		for (char c : token)
+		{
+			if (!(isalnum((unsigned char)c) || c == '_'))
+				return false;
+		}
+		return true;
+	}
+
+}
+
+bool NoiseChannelGraph::Load(const char* fileName, std::string& error)
+{
+	std::ifstream file(fileName);
+	if (!file)
+	{
+		error = std::string("cannot open ") + fileName;
+		return false;
+	}
+	std::stringstream text;
+	text << file.rdbuf();
+	return Parse(text.str(), error);
+}
+
+bool NoiseChannelGraph::Parse(const std::string& text, std::string& error)
+{
+	std::vector<Volume> volumes;
+	std::map<std::string, int> names;		// nodes of the current volume
+
+	std::istringstream lines(text);
+	std::string line;
+	int lineIndex = 0;
+	while (std::getline(lines, line))
+	{
+		lineIndex++;
+		const size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.resize(comment);
+
+		std::istringstream tokenStream(line);
+		std::vector<std::string> tokens;
+		std::string token;
+		while (tokenStream >> token)
+			tokens.push_back(token);
+		if (tokens.empty())
+			continue;
+
+		auto fail = [&](const std::string& message)
+		{
+			error = "line " + std::to_string(lineIndex) + ": " + message;
+			return false;
+		};
+
+		if (tokens[0] == "volume")
+		{
+			float size;
+			if (tokens.size() != 3 || !IsIdentifier(tokens[1]) || !ParseNumber(tokens[2], size) || size < 1.0f || float(int(size)) != size)
+				return fail("expected volume <name> <size>");
+			Volume volume;
+			volume.name = tokens[1];
+			volume.size = int(size);
+			volume.declaredNoiseCount = 0;
+			volumes.push_back(volume);
+			names.clear();
+			continue;
+		}
+		if (volumes.empty())
+			return fail("statement outside of a volume");
+		Volume& volume = volumes.back();
+
+		// Operands are previously defined nodes or constants
+		auto operand = [&](const std::string& name, int& node)
+		{
+			std::map<std::string, int>::const_iterator it = names.find(name);
+			if (it != names.end())
+			{
+				node = it->second;
+				return true;
+			}
+			float value;
+			if (!ParseNumber(name, value))
+				return false;
+			Node constant;
+			constant.op = Op::Constant;
+			constant.params[0] = value;
+			constant.params[1] = 0.0f;
+			node = int(volume.nodes.size());
+			volume.nodes.push_back(constant);
+			return true;
+		};
+
+		if (tokens[0] == "output" || tokens[0] == "output16f" || tokens[0] == "output32f")
+		{
+			if (tokens.size() < 3 || tokens.size() == 5 || tokens.size() > 7)
+				return fail("expected " + tokens[0] + " <fileName> <r> <g> <b> <a> [<tag>] or " + tokens[0] + " <fileName> <r> [<tag>]");
+			Output output;
+			output.fileName = tokens[1];
+			output.format = tokens[0] == "output16f" ? OutputFormat::Half : tokens[0] == "output32f" ? OutputFormat::Float : OutputFormat::Unorm8;
+			output.channelCount = tokens.size() < 5 ? 1 : 4;
+			if (tokens.size() == size_t(3 + output.channelCount))
+				output.tag = tokens.back();
+			for (int c = 0; c < output.channelCount; c++)
+			{
+				if (!operand(tokens[2 + c], output.channels[c]))
+					return fail("undefined identifier " + tokens[2 + c]);
+			}
+			// Single channel outputs repeat their channel so that all the outputs compile to 4 registers
+			for (int c = output.channelCount; c < 4; c++)
+				output.channels[c] = output.channels[0];
+			volume.outputs.push_back(output);
+			continue;
+		}
+
+		if (tokens.size() < 3 || tokens[1] != "=" || !IsIdentifier(tokens[0]))
+			return fail("expected <identifier> = <operation> <operands>");
+		if (names.count(tokens[0]))
+			return fail(tokens[0] + " is already defined");
+
+		Node node;
+		node.params[0] = 0.0f;
+		node.params[1] = 0.0f;
+		const std::string& operation = tokens[2];
+		const int operandCount = int(tokens.size()) - 3;
+		if (operation == "perlin")
+		{
+			node.op = Op::Perlin;
+			if (operandCount != 2 || !ParseNumber(tokens[3], node.params[0]) || !ParseNumber(tokens[4], node.params[1]) || node.params[1] < 1.0f)
+				return fail("expected perlin <frequency> <octaveCount>");
+			volume.declaredNoiseCount++;
+		}
+		else if (operation == "worley")
+		{
+			node.op = Op::Worley;
+			if (operandCount != 1 || !ParseNumber(tokens[3], node.params[0]) || node.params[0] <= 0.0f)
+				return fail("expected worley <cellCount>");
+			volume.declaredNoiseCount++;
+		}
+		else
+		{
+			int expectedCount;
+			if (operation == "fbm")				{ node.op = Op::Fbm;		expectedCount = operandCount >= 2 && operandCount % 2 == 0 ? operandCount : -1; }
+			else if (operation == "remap")		{ node.op = Op::Remap;		expectedCount = 5; }
+			else if (operation == "saturate")	{ node.op = Op::Saturate;	expectedCount = 1; }
+			else if (operation == "add")		{ node.op = Op::Add;		expectedCount = 2; }
+			else if (operation == "sub")		{ node.op = Op::Sub;		expectedCount = 2; }
+			else if (operation == "mul")		{ node.op = Op::Mul;		expectedCount = 2; }
+			else
+				return fail("unknown operation " + operation);
+			if (operandCount != expectedCount)
+				return fail("wrong operand count for " + operation);
+
+			for (int i = 0; i < operandCount; i++)
+			{
+				int arg;
+				if (!operand(tokens[3 + i], arg))
+					return fail("undefined identifier " + tokens[3 + i]);
+				node.args.push_back(arg);
+			}
+		}
+		names[tokens[0]] = int(volume.nodes.size());
+		volume.nodes.push_back(node);
+	}
+
+	for (Volume& volume : volumes)
+		Compile(volume);
+	mVolumes.swap(volumes);
+	ShareNoiseAcrossVolumes();
+	return true;
+}
+
+void NoiseChannelGraph::SelectOutputs(const std::vector<std::string>& tags)
+{
+	std::vector<Volume> volumes;
+	for (Volume& volume : mVolumes)
+	{
+		std::vector<Output> outputs;
+		for (const Output& output : volume.outputs)
+		{
+			if (std::find(tags.begin(), tags.end(), output.tag) != tags.end())
+				outputs.push_back(output);
+		}
+		if (outputs.empty())
+			continue;
+
+		// Compiling again only keeps the nodes of the remaining outputs
+		volume.outputs.swap(outputs);
+		Compile(volume);
+		volumes.push_back(volume);
+	}
+	mVolumes.swap(volumes);
+	ShareNoiseAcrossVolumes();
+}
+
+void NoiseChannelGraph::SingleChannelOutputs(const std::vector<std::string>& tags)
+{
+	for (Volume& volume : mVolumes)
+	{
+		bool changed = false;
+		for (Output& output : volume.outputs)
+		{
+			if (output.channelCount == 1 || std::find(tags.begin(), tags.end(), output.tag) == tags.end())
+				continue;
+			output.channelCount = 1;
+			for (int c = 1; c < 4; c++)
+				output.channels[c] = output.channels[0];
+			changed = true;
+		}
+		if (changed)
+			Compile(volume);
+	}
+	ShareNoiseAcrossVolumes();
+}
+
+void NoiseChannelGraph::AddMipVolumes()
+{
+	const size_t volumeCount = mVolumes.size();
+	for (size_t v = 0; v < volumeCount; v++)
+	{
+		const int levelCount = VolumeMips::GetLevelCount(mVolumes[v].size);
+		for (int level = 1; level <= levelCount; level++)
+		{
+			Volume mip = mVolumes[v];
+			mip.name += "_mip" + std::to_string(level);
+			mip.size >>= level;
+			const float nyquist = 0.5f * float(mip.size);
+			mip.declaredNoiseCount = 0;
+			for (Node& node : mip.nodes)
+			{
+				if (node.op == Op::Perlin)
+				{
+					// Octave k has a frequency of frequency * 2^k
+					int octaveCount = 0;
+					for (float frequency = node.params[0]; octaveCount < int(node.params[1]) && frequency <= nyquist; frequency *= 2.0f)
+						octaveCount++;
+					node.params[1] = float(octaveCount);
+					if (octaveCount == 0)
+					{
+						node.op = Op::Constant;
+						node.params[0] = PerlinAverage;
+					}
+				}
+				else if (node.op == Op::Worley && node.params[0] > nyquist)
+				{
+					node.op = Op::Constant;
+					node.params[0] = WorleyAverage;
+				}
+				mip.declaredNoiseCount += IsNoise(node.op) ? 1 : 0;
+			}
+			for (Output& output : mip.outputs)
+				output.fileName = VolumeMips::GetLevelFileName(output.fileName, level);
+			Compile(mip);
+			mVolumes.push_back(mip);
+		}
+	}
+	ShareNoiseAcrossVolumes();
+}
+
+int NoiseChannelGraph::GetSharedNoiseCount(int volume) const
+{
+	int count = 0;
+	for (const Noise& noise : mVolumes[volume].noises)
+	{
+		if (noise.sharedBuffer >= 0)
+			count++;
+	}
+	return count;
+}
+
+void NoiseChannelGraph::Compile(Volume& volume)
+{
+	const int nodeCount = int(volume.nodes.size());
+
+	// Merge identical nodes. Operands are always defined before their users, so a single pass in order sees the
+	// operands already merged.
+	std::vector<int> canonical(nodeCount);
+	std::map<std::pair<std::vector<int>, std::vector<float>>, int> uniqueNodes;
+	for (int i = 0; i < nodeCount; i++)
+	{
+		Node& node = volume.nodes[i];
+		std::vector<int> key(1, int(node.op));
+		for (int& arg : node.args)
+		{
+			arg = canonical[arg];
+			key.push_back(arg);
+		}
+		const std::vector<float> params(node.params, node.params + 2);
+		canonical[i] = uniqueNodes.insert(std::make_pair(std::make_pair(key, params), i)).first->second;
+	}
+
+	// Keep the nodes the outputs depend on
+	std::vector<bool> live(nodeCount, false);
+	for (Output& output : volume.outputs)
+	{
+		for (int& channel : output.channels)
+		{
+			channel = canonical[channel];
+			live[channel] = true;
+		}
+	}
+	for (int i = nodeCount - 1; i >= 0; i--)
+	{
+		if (live[i])
+		{
+			for (int arg : volume.nodes[i].args)
+				live[arg] = true;
+		}
+	}
+
+	std::vector<int> registers(nodeCount, -1);
+	volume.registerCount = 0;
+	volume.constants.clear();
+	volume.noises.clear();
+	volume.program.clear();
+	for (int i = 0; i < nodeCount; i++)
+	{
+		if (!live[i])
+			continue;
+		const Node& node = volume.nodes[i];
+		const int dst = volume.registerCount++;
+		registers[i] = dst;
+		if (node.op == Op::Constant)
+		{
+			volume.constants.push_back(std::make_pair(dst, node.params[0]));
+		}
+		else if (IsNoise(node.op))
+		{
+			Noise noise;
+			noise.reg = dst;
+			noise.node = node;
+			noise.sharedBuffer = -1;
+			volume.noises.push_back(noise);
+		}
+		else
+		{
+			Instruction instruction;
+			instruction.op = node.op;
+			instruction.dst = dst;
+			for (int arg : node.args)
+				instruction.args.push_back(registers[arg]);
+			volume.program.push_back(instruction);
+		}
+	}
+
+	volume.outputRegisters.clear();
+	for (const Output& output : volume.outputs)
+	{
+		for (int channel : output.channels)
+			volume.outputRegisters.push_back(registers[channel]);
+	}
+}
+
+bool NoiseChannelGraph::HaveCoincidentVoxels(int size, int targetSize)
+{
+	// Voxel i of the target volume must land exactly on voxel i * stride, with the coordinates computed as in EvaluateNoise
+	if (targetSize > size || size % targetSize != 0)
+		return false;
+	const int stride = size / targetSize;
+	const float normFact = 1.0f / float(size);
+	const float targetNormFact = 1.0f / float(targetSize);
+	for (int i = 0; i < targetSize; i++)
+	{
+		if (float(i) * targetNormFact != float(i * stride) * normFact)
+			return false;
+	}
+	return true;
+}
+
+void NoiseChannelGraph::ShareNoiseAcrossVolumes()
+{
+	UnshareNoise();
+	for (size_t v = 1; v < mVolumes.size(); v++)
+	{
+		Volume& volume = mVolumes[v];
+		for (Noise& noise : volume.noises)
+		{
+			// Look for the same noise evaluated by an earlier volume
+			for (size_t source = 0; source < v && noise.sharedBuffer < 0; source++)
+			{
+				Volume& sourceVolume = mVolumes[source];
+				if (!HaveCoincidentVoxels(sourceVolume.size, volume.size))
+					continue;
+				for (size_t n = 0; n < sourceVolume.noises.size(); n++)
+				{
+					Noise& sourceNoise = sourceVolume.noises[n];
+					if (sourceNoise.sharedBuffer >= 0 || sourceNoise.node.op != noise.node.op
+						|| sourceNoise.node.params[0] != noise.node.params[0] || sourceNoise.node.params[1] != noise.node.params[1])
+						continue;
+
+					SharedBuffer buffer;
+					buffer.sourceVolume = int(source);
+					buffer.sourceNoise = int(n);
+					buffer.size = volume.size;
+					buffer.stride = sourceVolume.size / volume.size;
+					noise.sharedBuffer = int(mSharedBuffers.size());
+					sourceNoise.lentBuffers.push_back(noise.sharedBuffer);
+					mSharedBuffers.push_back(buffer);
+					break;
+				}
+			}
+		}
+	}
+}
+
+void NoiseChannelGraph::UnshareNoise()
+{
+	mSharedBuffers.clear();
+	for (Volume& volume : mVolumes)
+	{
+		for (Noise& noise : volume.noises)
+		{
+			noise.sharedBuffer = -1;
+			noise.lentBuffers.clear();
+		}
+	}
+}
+
+void NoiseChannelGraph::EvaluateNoise(const Volume& volume, const Node& node, const Range3d& block, const EvaluationOptions& options, float* out)
+{
+	const int count = block.volume();
+	if (node.op == Op::Worley)
+	{
+		// Inverted Worley noise, evaluated cell by cell
+		Tileable3dNoise::WorleyNoiseGrid(volume.size, block.begin, block.end, node.params[0], out, options.seed);
+		for (int v = 0; v < count; v++)
+			out[v] = 1.0f - out[v];
+		return;
+	}
+
+	const glm::vec3 normFact = glm::vec3(1.0f / float(volume.size));
+	const float frequency = node.params[0];
+	const int octaveCount = int(node.params[1]);
+	std::vector<float> coordX(count), coordY(count), coordZ(count);
+	int v = 0;
+	for (int r = block.begin.z; r < block.end.z; r++)
+		for (int t = block.begin.y; t < block.end.y; t++)
+			for (int s = block.begin.x; s < block.end.x; s++, v++)
+			{
+				glm::vec3 coord = glm::vec3(s, t, r) * normFact;
+				coordX[v] = coord.x;
+				coordY[v] = coord.y;
+				coordZ[v] = coord.z;
+			}
+	if (options.nativePerlin)
+	{
+		Tileable3dNoise::PerlinNoise3dBatch(coordX.data(), coordY.data(), coordZ.data(), out, count, frequency, octaveCount, options.seed);
+	}
+	else
+	{
+		for (v = 0; v < count; v++)
+			out[v] = Tileable3dNoise::PerlinNoise(glm::vec3(coordX[v], coordY[v], coordZ[v]), frequency, octaveCount, options.seed);
+	}
+}
+
+float NoiseChannelGraph::EstimateCost(const Volume& volume, const Noise& noise, const EvaluationOptions& options)
+{
+	// Rough nanoseconds per voxel measured on one core with the AVX-512 kernels, scaled to the active backend. Only the
+	// ratios between nodes matter. Scalar Perlin goes through glm whatever the backend.
+	const int backend = int(Tileable3dNoise::GetBackend());
+	if (noise.sharedBuffer >= 0)
+		return SharedNoiseCost;
+	if (noise.node.op == Op::Perlin)
+		return (options.nativePerlin ? 25.0f * PerlinBackendFactors[backend] : 700.0f) * noise.node.params[1];
+	// WorleyNoiseGrid sweeps cell by cell when cells cover enough voxels, else evaluates voxels in batches
+	return (float(volume.size) >= 16.0f * noise.node.params[0] ? 12.0f : 30.0f) * WorleyBackendFactors[backend];
+}
+
+void NoiseChannelGraph::AddTasks(TaskGraph& graph, TaskSplit split, int threadCount, size_t memoryBudget, const EvaluationOptions& options,
+	const WriteFunction& write, std::vector<int>& volumeTasks)
+{
+	const int volumeCount = GetVolumeCount();
+
+	// Shared noise is kept for whole volumes, out of the budget of the windows
+	size_t sharedBytes = 0;
+	for (const SharedBuffer& buffer : mSharedBuffers)
+		sharedBytes += sizeof(float) * buffer.size * buffer.size * buffer.size;
+	if (memoryBudget > 0 && sharedBytes > 0)
+	{
+		if (sharedBytes <= memoryBudget / 2)
+			memoryBudget -= sharedBytes;
+		else
+			UnshareNoise();
+	}
+	for (SharedBuffer& buffer : mSharedBuffers)
+		buffer.values.resize(size_t(buffer.size) * buffer.size * buffer.size);
+
+	// Most expensive task of a brick per voxel, cost of everything and memory used per z slice
+	std::vector<float> maxCosts(volumeCount, 0.0f);
+	std::vector<size_t> sliceBytes(volumeCount);
+	double totalCost = 0.0;
+	double totalBytes = 0.0;
+	for (int v = 0; v < volumeCount; v++)
+	{
+		const Volume& volume = mVolumes[v];
+		const float combineCost = InstructionCost * float(volume.program.size() + volume.outputs.size());
+		float cost = combineCost;
+		maxCosts[v] = combineCost;
+		for (const Noise& noise : volume.noises)
+		{
+			const float noiseCost = EstimateCost(volume, noise, options);
+			cost += noiseCost;
+			maxCosts[v] = std::max(maxCosts[v], noiseCost);
+		}
+		totalCost += double(cost) * volume.size * volume.size * volume.size;
+
+		size_t voxelBytes = split == TaskSplit::Bricks ? sizeof(float) * volume.noises.size() : 0;
+		for (const Output& output : volume.outputs)
+			voxelBytes += output.GetTexelSize();
+		sliceBytes[v] = voxelBytes * volume.size * volume.size;
+		totalBytes += double(sliceBytes[v]) * volume.size;
+	}
+	// About 8 tasks per thread, unless they get too small
+	const double taskCost = std::max(totalCost / (8.0 * std::max(threadCount, 1)), MinTaskCost);
+
+	struct VolumeBricks
+	{
+		glm::ivec3 brickSize;
+		glm::ivec3 brickCount;
+		std::vector<int> noiseTasks;		// task evaluating each noise of each brick
+	};
+	std::vector<VolumeBricks> bricks(volumeCount);
+	mBrickValues.assign(volumeCount, std::vector<std::vector<float>>());
+	mWindowTexels.assign(volumeCount, std::vector<std::vector<std::vector<unsigned char>>>());
+	volumeTasks.assign(volumeCount, -1);
+	for (int v = 0; v < volumeCount; v++)
+	{
+		const Volume& volume = mVolumes[v];
+		const int size = volume.size;
+		const int noiseCount = int(volume.noises.size());
+		const int outputCount = int(volume.outputs.size());
+		VolumeBricks& volumeBricks = bricks[v];
+
+		// Halve the brick along z, then y, then x down to 8 voxels, until its most expensive task fits the task cost or
+		// one more halving would take it below MinBrickVoxelCount
+		glm::ivec3 brickSize(size);
+		if (split == TaskSplit::Slices)
+		{
+			brickSize.z = 1;
+		}
+		else
+		{
+			const double brickVoxels = taskCost / maxCosts[v];
+			while (double(brickSize.x) * brickSize.y * brickSize.z > brickVoxels)
+			{
+				glm::ivec3 halved(brickSize);
+				if (halved.z > 1)
+					halved.z = (halved.z + 1) / 2;
+				else if (halved.y > 1)
+					halved.y = (halved.y + 1) / 2;
+				else if (halved.x > 8)
+					halved.x = (halved.x + 1) / 2;
+				else
+					break;
+				if (double(halved.x) * halved.y * halved.z < MinBrickVoxelCount)
+					break;
+				brickSize = halved;
+			}
+		}
+		volumeBricks.brickSize = brickSize;
+		volumeBricks.brickCount = (glm::ivec3(size) + brickSize - glm::ivec3(1)) / brickSize;
+		const int brickCount = volumeBricks.brickCount.x * volumeBricks.brickCount.y * volumeBricks.brickCount.z;
+		if (split == TaskSplit::Bricks)
+			mBrickValues[v].resize(size_t(brickCount) * noiseCount);
+
+		// Windows of whole bricks, the budget being shared by the volumes in proportion of their size. Two windows of a
+		// volume are in memory at once, the one being written and the one being generated.
+		int windowSlices = size;
+		if (memoryBudget > 0)
+		{
+			const double volumeBudget = double(memoryBudget) * (double(sliceBytes[v]) * size / totalBytes);
+			windowSlices = int(std::min(volumeBudget / (2.0 * sliceBytes[v]), double(size)));
+		}
+		windowSlices = std::max(brickSize.z, windowSlices / brickSize.z * brickSize.z);
+		const int windowCount = (size + windowSlices - 1) / windowSlices;
+		mWindowTexels[v].resize(std::min(windowCount, 2));
+		for (std::vector<std::vector<unsigned char>>& slot : mWindowTexels[v])
+		{
+			slot.resize(outputCount);
+			for (int o = 0; o < outputCount; o++)
+				slot[o].resize(size_t(windowSlices) * size * size * volume.outputs[o].GetTexelSize());
+		}
+
+		std::vector<std::vector<int>> windowFirstTasks(windowCount);		// tasks reusing the memory of window - 2
+		std::vector<std::vector<int>> windowOutputTasks(windowCount);
+		for (int b = 0; b < brickCount; b++)
+		{
+			const glm::ivec3 brick(b % volumeBricks.brickCount.x, (b / volumeBricks.brickCount.x) % volumeBricks.brickCount.y,
+				b / (volumeBricks.brickCount.x * volumeBricks.brickCount.y));
+			const Range3d block(brick * brickSize, glm::min((brick + glm::ivec3(1)) * brickSize, glm::ivec3(size)));
+			const int window = block.begin.z / windowSlices;
+			const int slot = window % 2;
+			const int firstSlice = window * windowSlices;
+
+			int outputTask;
+			if (split == TaskSplit::Slices)
+			{
+				outputTask = graph.AddTask([this, v, slot, firstSlice, outputCount, block, options]()
+				{
+					std::vector<unsigned char*> outputs(outputCount);
+					for (int o = 0; o < outputCount; o++)
+						outputs[o] = mWindowTexels[v][slot][o].data();
+					EvaluateBlock(v, block, options, outputs.data(), firstSlice);
+				}, block);
+				volumeBricks.noiseTasks.insert(volumeBricks.noiseTasks.end(), noiseCount, outputTask);
+				windowFirstTasks[window].push_back(outputTask);
+			}
+			else
+			{
+				for (int i = 0; i < noiseCount; i++)
+				{
+					const int noiseTask = graph.AddTask([this, v, b, i, noiseCount, block, options]()
+					{
+						std::vector<float>& values = mBrickValues[v][size_t(b) * noiseCount + i];
+						values.resize(block.volume());
+						EvaluateNoiseBlock(v, i, block, options, values.data());
+					}, block);
+					volumeBricks.noiseTasks.push_back(noiseTask);
+					windowFirstTasks[window].push_back(noiseTask);
+				}
+				outputTask = graph.AddTask([this, v, b, slot, firstSlice, noiseCount, outputCount, block, options]()
+				{
+					std::vector<const float*> noiseValues(noiseCount);
+					for (int i = 0; i < noiseCount; i++)
+						noiseValues[i] = mBrickValues[v][size_t(b) * noiseCount + i].data();
+					std::vector<unsigned char*> outputs(outputCount);
+					for (int o = 0; o < outputCount; o++)
+						outputs[o] = mWindowTexels[v][slot][o].data();
+					CombineBlock(v, block, noiseValues.data(), options, firstSlice, outputs.data());
+					for (int i = 0; i < noiseCount; i++)
+						std::vector<float>().swap(mBrickValues[v][size_t(b) * noiseCount + i]);
+				}, block);
+				for (int i = 0; i < noiseCount; i++)
+					graph.AddDependency(volumeBricks.noiseTasks[size_t(b) * noiseCount + i], outputTask);
+			}
+			windowOutputTasks[window].push_back(outputTask);
+
+			// Noise reused from an earlier volume waits for the bricks of the source covering block * stride
+			std::vector<std::pair<int, int>> dependencies;
+			for (int i = 0; i < noiseCount; i++)
+			{
+				const Noise& noise = volume.noises[i];
+				if (noise.sharedBuffer < 0)
+					continue;
+				const SharedBuffer& buffer = mSharedBuffers[noise.sharedBuffer];
+				const VolumeBricks& source = bricks[buffer.sourceVolume];
+				const int sourceNoiseCount = int(mVolumes[buffer.sourceVolume].noises.size());
+				const glm::ivec3 first = block.begin * buffer.stride / source.brickSize;
+				const glm::ivec3 last = (block.end - glm::ivec3(1)) * buffer.stride / source.brickSize;
+				for (int z = first.z; z <= last.z; z++)
+					for (int y = first.y; y <= last.y; y++)
+						for (int x = first.x; x <= last.x; x++)
+						{
+							const int sourceBrick = (z * source.brickCount.y + y) * source.brickCount.x + x;
+							const std::pair<int, int> dependency(source.noiseTasks[size_t(sourceBrick) * sourceNoiseCount + buffer.sourceNoise],
+								volumeBricks.noiseTasks[size_t(b) * noiseCount + i]);
+							if (std::find(dependencies.begin(), dependencies.end(), dependency) == dependencies.end())
+								dependencies.push_back(dependency);
+						}
+			}
+			for (const std::pair<int, int>& dependency : dependencies)
+				graph.AddDependency(dependency.first, dependency.second);
+		}
+
+		// Windows are written in order, and their memory is reused by the window after the next one
+		int previousWrite = -1;
+		for (int window = 0; window < windowCount; window++)
+		{
+			const int slot = window % 2;
+			const int firstSlice = window * windowSlices;
+			const int sliceCount = std::min(windowSlices, size - firstSlice);
+			const bool lastWindow = window == windowCount - 1;
+			const Range3d windowRange(glm::ivec3(0, 0, firstSlice), glm::ivec3(size, size, firstSlice + sliceCount));
+			const int writeTask = graph.AddTask([this, v, slot, firstSlice, sliceCount, outputCount, lastWindow, write]()
+			{
+				std::vector<const unsigned char*> texels(outputCount);
+				for (int o = 0; o < outputCount; o++)
+					texels[o] = mWindowTexels[v][slot][o].data();
+				write(v, firstSlice, sliceCount, texels.data());
+				if (lastWindow)
+					std::vector<std::vector<std::vector<unsigned char>>>().swap(mWindowTexels[v]);
+			}, windowRange);
+			for (int outputTask : windowOutputTasks[window])
+				graph.AddDependency(outputTask, writeTask);
+			if (previousWrite >= 0)
+				graph.AddDependency(previousWrite, writeTask);
+			if (window + 2 < windowCount)
+			{
+				for (int task : windowFirstTasks[window + 2])
+					graph.AddDependency(writeTask, task);
+			}
+			previousWrite = writeTask;
+		}
+		volumeTasks[v] = previousWrite;
+	}
+}
+
+void NoiseChannelGraph::EvaluateBlock(int volumeIndex, const Range3d& block, const EvaluationOptions& options, unsigned char* const* outputs, int firstSlice)
+{
+	// Noise for the whole block first, then the arithmetic of all the outputs in a single pass over the rows
+	const int count = block.volume();
+	const int noiseCount = int(mVolumes[volumeIndex].noises.size());
+	std::vector<float> noiseValues(size_t(noiseCount) * count);
+	std::vector<const float*> noiseValuesPtr(noiseCount);
+	for (int i = 0; i < noiseCount; i++)
+	{
+		noiseValuesPtr[i] = &noiseValues[size_t(i) * count];
+		EvaluateNoiseBlock(volumeIndex, i, block, options, &noiseValues[size_t(i) * count]);
+	}
+	CombineBlock(volumeIndex, block, noiseValuesPtr.data(), options, firstSlice, outputs);
+}
+
+void NoiseChannelGraph::EvaluateNoiseBlock(int volumeIndex, int noiseIndex, const Range3d& block, const EvaluationOptions& options, float* values)
+{
+	const Volume& volume = mVolumes[volumeIndex];
+	const Noise& noise = volume.noises[noiseIndex];
+	if (noise.sharedBuffer >= 0)
+	{
+		const SharedBuffer& buffer = mSharedBuffers[noise.sharedBuffer];
+		const size_t size = size_t(buffer.size);
+		int v = 0;
+		for (int r = block.begin.z; r < block.end.z; r++)
+			for (int t = block.begin.y; t < block.end.y; t++)
+				for (int s = block.begin.x; s < block.end.x; s++, v++)
+					values[v] = buffer.values[(r * size + t) * size + s];
+		return;
+	}
+
+	EvaluateNoise(volume, noise.node, block, options, values);
+	for (int bufferIndex : noise.lentBuffers)
+	{
+		// Keep the voxels coinciding with the ones of the later volume
+		SharedBuffer& buffer = mSharedBuffers[bufferIndex];
+		const int stride = buffer.stride;
+		const size_t size = size_t(buffer.size);
+		int v = 0;
+		for (int r = block.begin.z; r < block.end.z; r++)
+			for (int t = block.begin.y; t < block.end.y; t++)
+				for (int s = block.begin.x; s < block.end.x; s++, v++)
+				{
+					if (r % stride == 0 && t % stride == 0 && s % stride == 0)
+						buffer.values[((r / stride) * size + t / stride) * size + s / stride] = values[v];
+				}
+	}
+}
+
+void NoiseChannelGraph::CombineBlock(int volumeIndex, const Range3d& block, const float* const* noiseValues, const EvaluationOptions& options,
+	int firstSlice, unsigned char* const* outputs) const
+{
+	const Volume& volume = mVolumes[volumeIndex];
+	const int noiseCount = int(volume.noises.size());
+	const int outputCount = int(volume.outputs.size());
+	const int rowLength = block.end.x - block.begin.x;
+
+	// The program runs on a row of voxels at a time, each register being a row of values and each instruction a loop
+	// over it. Noise registers point to the noise values of the row.
+	std::vector<float> storage(size_t(volume.registerCount) * rowLength);
+	std::vector<const float*> rows(volume.registerCount);
+	for (int i = 0; i < volume.registerCount; i++)
+		rows[i] = &storage[size_t(i) * rowLength];
+	for (const std::pair<int, float>& constant : volume.constants)
+		std::fill(&storage[size_t(constant.first) * rowLength], &storage[size_t(constant.first + 1) * rowLength], constant.second);
+
+	std::vector<float> bias(options.quantization == Quantization::Dither ? rowLength : 0);
+	std::vector<float> interleaved;
+	for (const Output& output : volume.outputs)
+	{
+		if (output.format == OutputFormat::Half && output.channelCount > 1)
+			interleaved.resize(size_t(rowLength) * output.channelCount);
+	}
+
+	const size_t size = size_t(volume.size);
+	size_t v = 0;
+	for (int r = block.begin.z; r < block.end.z; r++)
+	{
+		for (int t = block.begin.y; t < block.end.y; t++, v += rowLength)
+		{
+			for (int i = 0; i < noiseCount; i++)
+				rows[volume.noises[i].reg] = noiseValues[i] + v;
+
+			for (const Instruction& instruction : volume.program)
+			{
+				const int* a = instruction.args.data();
+				float* dst = &storage[size_t(instruction.dst) * rowLength];
+				switch (instruction.op)
+				{
+				case Op::Fbm:
+				{
+					const float* x = rows[a[0]];
+					const float* w = rows[a[1]];
+					for (int i = 0; i < rowLength; i++)
+						dst[i] = x[i] * w[i];
+					for (size_t k = 2; k < instruction.args.size(); k += 2)
+					{
+						x = rows[a[k]];
+						w = rows[a[k + 1]];
+						for (int i = 0; i < rowLength; i++)
+							dst[i] = dst[i] + x[i] * w[i];
+					}
+					break;
+				}
+				case Op::Remap:
+				{
+					// As in the shaders described in GPU Pro 7, it must match when using pre packed textures
+					const float* x = rows[a[0]];
+					const float* min = rows[a[1]];
+					const float* max = rows[a[2]];
+					const float* newMin = rows[a[3]];
+					const float* newMax = rows[a[4]];
+					for (int i = 0; i < rowLength; i++)
+						dst[i] = newMin[i] + (((x[i] - min[i]) / (max[i] - min[i])) * (newMax[i] - newMin[i]));
+					break;
+				}
+				case Op::Saturate:
+				{
+					const float* x = rows[a[0]];
+					for (int i = 0; i < rowLength; i++)
+					{
+						const float value = std::fminf(x[i], 1.0f);
+						dst[i] = std::fmaxf(value, 0.0f);
+					}
+					break;
+				}
+				case Op::Add:
+				case Op::Sub:
+				case Op::Mul:
+				{
+					const float* x = rows[a[0]];
+					const float* y = rows[a[1]];
+					if (instruction.op == Op::Add)
+						for (int i = 0; i < rowLength; i++)
+							dst[i] = x[i] + y[i];
+					else if (instruction.op == Op::Sub)
+						for (int i = 0; i < rowLength; i++)
+							dst[i] = x[i] - y[i];
+					else
+						for (int i = 0; i < rowLength; i++)
+							dst[i] = x[i] * y[i];
+					break;
+				}
+				default:
+					break;
+				}
+			}
+
+			// Channel planes of the row to the texels of each output
+			if (!bias.empty())
+			{
+				for (int i = 0; i < rowLength; i++)
+					bias[i] = DitherThreshold(block.begin.x + i, t, r);
+			}
+			const size_t rowTexel = (size_t(r - firstSlice) * size + t) * size + block.begin.x;
+			for (int o = 0; o < outputCount; o++)
+			{
+				const Output& output = volume.outputs[o];
+				const int channelCount = output.channelCount;
+				const int* channels = &volume.outputRegisters[o * 4];
+				const float* planes[4] = { rows[channels[0]], rows[channels[1]], rows[channels[2]], rows[channels[3]] };
+				if (output.format == OutputFormat::Unorm8)
+				{
+					Tileable3dNoise::QuantizeUnorm8Batch(planes, channelCount, rowLength, bias.empty() ? nullptr : bias.data(),
+						options.quantization == Quantization::Round, outputs[o] + rowTexel * channelCount);
+					continue;
+				}
+
+				unsigned short* halfDst = (unsigned short*)outputs[o] + rowTexel * channelCount;
+				if (output.format == OutputFormat::Half && channelCount == 1)
+				{
+					Tileable3dNoise::FloatToHalfBatch(planes[0], halfDst, rowLength);
+					continue;
+				}
+				float* dst = output.format == OutputFormat::Float ? (float*)outputs[o] + rowTexel * channelCount : interleaved.data();
+				for (int i = 0; i < rowLength; i++)
+				{
+					for (int c = 0; c < channelCount; c++)
+						dst[size_t(i) * channelCount + c] = planes[c][i];
+				}
+				if (output.format == OutputFormat::Half)
+					Tileable3dNoise::FloatToHalfBatch(dst, halfDst, rowLength * channelCount);
+			}
+		}
+	}
+}
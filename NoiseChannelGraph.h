@@ -0,0 +1,223 @@
+#ifndef D_NOISECHANNELGRAPH
+#define D_NOISECHANNELGRAPH
+
+#include "TaskScheduler.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+///
+/// Channels of noise volumes described in a small text format, one statement per line, # starting a comment:
+///   volume <name> <size>                         starts a size^3 volume, the statements below belong to it
+///   <id> = perlin <frequency> <octaveCount>      Tileable3dNoise::PerlinNoise (or PerlinNoise3d, see EvaluationOptions)
+///   <id> = worley <cellCount>                    inverted Worley noise, 1 - Tileable3dNoise::WorleyNoise
+///   <id> = fbm <a> <weightA> <b> <weightB> ...   a * weightA + b * weightB + ..., summed from left to right
+///   <id> = remap <x> <min> <max> <newMin> <newMax>
+///   <id> = saturate <x>                          clamp to [0, 1]
+///   <id> = add|sub|mul <a> <b>
+///   output <fileName> <r> <g> <b> <a> [<tag>]    RGBA8 volume, channels in [0, 1] are scaled by 255. The optional tag
+///                                                can select the output with SelectOutputs
+///   output <fileName> <r> [<tag>]                R8 volume, e.g. for packed channels
+///   output16f|output32f <fileName> ...           same as output with half or float channels, stored as is
+/// Operands are identifiers defined above in the same volume, or numbers.
+///
+/// Nodes no output depends on are dropped and identical nodes are merged, so each distinct noise is evaluated once
+/// per voxel. The arithmetic of all the outputs of a volume then runs as a single program over rows of voxels. The
+/// program is interpreted, one loop over the row per instruction, rather than compiled to a fused per voxel kernel:
+/// the noise nodes dominate the cost and run as batched SIMD kernels or cell sweeps over whole blocks, which a per
+/// voxel kernel could not use, and the row loops vectorize well enough for the few instructions left.
+///
+/// A noise node of a volume whose voxels all coincide with voxels of an earlier volume evaluating the same noise, e.g.
+/// a 32^3 volume and a 128^3 one, is not evaluated again: the earlier volume keeps a copy of the values at the
+/// coincident voxels. Volumes must then be evaluated in order.
+///
+class NoiseChannelGraph
+{
+public:
+
+	/// How the channels of 8 bit outputs are converted from [0, 1], see Tileable3dNoise::QuantizeUnorm8Batch.
+	enum class Quantization
+	{
+		Truncate,		///< value * 255 truncated, the original textures.
+		Round,			///< value * 255 rounded to nearest.
+		Dither,			///< value * 255 plus a 4x4x4 ordered dithering threshold, truncated.
+	};
+
+	struct EvaluationOptions
+	{
+		bool nativePerlin;			///< perlin nodes use Tileable3dNoise::PerlinNoise3d.
+		int seed;					///< Seed of all the noise nodes.
+		Quantization quantization;
+
+		EvaluationOptions() : nativePerlin(false), seed(0), quantization(Quantization::Truncate) {}
+	};
+
+	/// Parses and compiles a graph, replacing the current one.
+	/// @return false with a message on syntax errors or undefined identifiers.
+	bool Parse(const std::string& text, std::string& error);
+
+	/// Parse() of the content of a file.
+	bool Load(const char* fileName, std::string& error);
+
+	/// Type of the channels of an output.
+	enum class OutputFormat
+	{
+		Unorm8,		///< output, channels in [0, 1] scaled by 255, see Quantization.
+		Half,		///< output16f, IEEE half floats rounded to nearest even.
+		Float,		///< output32f
+	};
+
+	/// Only keeps the outputs whose tag is in tags, then the volumes with outputs left. The nodes only the other outputs
+	/// depended on are not evaluated anymore.
+	void SelectOutputs(const std::vector<std::string>& tags);
+
+	/// Only keeps the first channel of the outputs whose tag is in tags, e.g. to write as R8 the packed outputs repeating
+	/// the same value in R, G and B. The nodes only the other channels depended on are not evaluated anymore.
+	void SingleChannelOutputs(const std::vector<std::string>& tags);
+
+	/// Appends a volume <name>_mip<level> per mip level of each volume (see VolumeMips::GetLevelCount), writing the
+	/// outputs to VolumeMips::GetLevelFileName. The noise is evaluated at the resolution of the level, band limited:
+	/// perlin octaves with a frequency above half the level size are dropped (the remaining ones being normalized
+	/// again), and perlin and worley nodes entirely above it are replaced by their average value. Noise nodes left
+	/// unchanged are reused from the volume of the first level.
+	void AddMipVolumes();
+
+	int GetVolumeCount() const { return int(mVolumes.size()); }
+	const std::string& GetVolumeName(int volume) const { return mVolumes[volume].name; }
+	int GetVolumeSize(int volume) const { return mVolumes[volume].size; }
+	int GetOutputCount(int volume) const { return int(mVolumes[volume].outputs.size()); }
+	const std::string& GetOutputFileName(int volume, int output) const { return mVolumes[volume].outputs[output].fileName; }
+	const std::string& GetOutputTag(int volume, int output) const { return mVolumes[volume].outputs[output].tag; }
+	int GetOutputChannelCount(int volume, int output) const { return mVolumes[volume].outputs[output].channelCount; }
+	OutputFormat GetOutputFormat(int volume, int output) const { return mVolumes[volume].outputs[output].format; }
+	/// Bytes per texel.
+	int GetOutputTexelSize(int volume, int output) const { return mVolumes[volume].outputs[output].GetTexelSize(); }
+
+	/// Number of noise nodes written in the volume, number actually evaluated per voxel once compiled and number
+	/// reused from earlier volumes.
+	int GetDeclaredNoiseCount(int volume) const { return mVolumes[volume].declaredNoiseCount; }
+	int GetEvaluatedNoiseCount(int volume) const { return int(mVolumes[volume].noises.size()) - GetSharedNoiseCount(volume); }
+	int GetSharedNoiseCount(int volume) const;
+
+	/// Evaluates the voxels of block, writing the texels of the outputs into outputs[0 .. GetOutputCount - 1], each one a size^3
+	/// volume starting at z slice firstSlice with x being the fastest varying index. Blocks of a volume can be evaluated
+	/// concurrently, but the earlier volumes it reuses noise from must have been evaluated before.
+	void EvaluateBlock(int volume, const Range3d& block, const EvaluationOptions& options, unsigned char* const* outputs, int firstSlice = 0);
+
+	/// How AddTasks splits the generation of a volume.
+	enum class TaskSplit
+	{
+		Slices,		///< One task per z slice evaluating all the channels.
+		Bricks,		///< One task per brick and noise node, then one per brick running the channel program. Bricks are sized
+					///< with an estimate of the cost of each noise so that there are several tasks per thread.
+	};
+
+	/// Receives the texels of the z slices [firstSlice, firstSlice + sliceCount) of the outputs of a volume, texels[output]
+	/// being sliceCount * size^2 texels of GetOutputTexelSize bytes with x being the fastest varying index.
+	typedef std::function<void(int volume, int firstSlice, int sliceCount, const unsigned char* const* texels)> WriteFunction;
+
+	/// Adds the tasks generating all the volumes to graph, including the dependencies between volumes sharing noise.
+	/// Volumes are generated by windows of z slices, each one passed to write once complete, in order, then recycled:
+	/// a window is generated while the previous one is written.
+	/// @param threadCount number of threads the graph will run on, used to size the bricks.
+	/// @param memoryBudget bytes of texels and intermediate noise values the windows of all the volumes can use,
+	/// 0 for whole volume windows. A window has at least one slice (or one brick in z). Noise shared across volumes is
+	/// kept for whole volumes and counted first; volumes evaluate it themselves when it would take over half the budget.
+	/// @param volumeTasks receives the last task of each volume, its last write.
+	void AddTasks(TaskGraph& graph, TaskSplit split, int threadCount, size_t memoryBudget, const EvaluationOptions& options,
+		const WriteFunction& write, std::vector<int>& volumeTasks);
+
+private:
+
+	enum class Op
+	{
+		Constant,
+		Perlin,
+		Worley,
+		Fbm,
+		Remap,
+		Saturate,
+		Add,
+		Sub,
+		Mul,
+	};
+
+	struct Node
+	{
+		Op op;
+		std::vector<int> args;		///< Operand nodes.
+		float params[2];			///< Constant value, Perlin frequency and octave count or Worley cell count.
+	};
+
+	struct Output
+	{
+		std::string fileName;
+		std::string tag;
+		OutputFormat format;
+		int channelCount;			///< 4 for RGBA, 1 for R.
+		int channels[4];			///< Nodes, the first one repeated for R.
+
+		int GetTexelSize() const { return channelCount * (format == OutputFormat::Unorm8 ? 1 : format == OutputFormat::Half ? 2 : 4); }
+	};
+
+	/// One step of the per voxel program: registers are the compiled nodes.
+	struct Instruction
+	{
+		Op op;
+		int dst;
+		std::vector<int> args;
+	};
+
+	struct Noise
+	{
+		int reg;
+		Node node;
+		int sharedBuffer;					///< Buffer holding the values computed by an earlier volume, -1 if evaluated here.
+		std::vector<int> lentBuffers;		///< Buffers receiving the values needed by later volumes.
+	};
+
+	/// Values of a noise at the voxels of a volume coinciding with voxels of an earlier volume.
+	struct SharedBuffer
+	{
+		int sourceVolume;
+		int sourceNoise;
+		int size;
+		int stride;							///< Voxel size in voxels of the earlier volume.
+		std::vector<float> values;			///< size^3 values, allocated by AddTasks.
+	};
+
+	struct Volume
+	{
+		std::string name;
+		int size;
+		std::vector<Node> nodes;
+		std::vector<Output> outputs;
+		int declaredNoiseCount;
+
+		// Compiled
+		int registerCount;
+		std::vector<std::pair<int, float>> constants;		///< Register and value.
+		std::vector<Noise> noises;
+		std::vector<Instruction> program;
+		std::vector<int> outputRegisters;					///< 4 per output.
+	};
+
+	static bool IsNoise(Op op) { return op == Op::Perlin || op == Op::Worley; }
+	static void Compile(Volume& volume);
+	static bool HaveCoincidentVoxels(int size, int targetSize);
+	void ShareNoiseAcrossVolumes();
+	void UnshareNoise();
+	static void EvaluateNoise(const Volume& volume, const Node& node, const Range3d& block, const EvaluationOptions& options, float* out);
+	static float EstimateCost(const Volume& volume, const Noise& noise, const EvaluationOptions& options);
+	void EvaluateNoiseBlock(int volume, int noise, const Range3d& block, const EvaluationOptions& options, float* values);
+	void CombineBlock(int volume, const Range3d& block, const float* const* noiseValues, const EvaluationOptions& options, int firstSlice,
+		unsigned char* const* outputs) const;
+
+	std::vector<Volume> mVolumes;
+	std::vector<SharedBuffer> mSharedBuffers;
+	std::vector<std::vector<std::vector<float>>> mBrickValues;		///< Per volume, brick and noise for TaskSplit::Bricks.
+	std::vector<std::vector<std::vector<std::vector<unsigned char>>>> mWindowTexels;	///< Per volume, window slot and output.
+};
+
+#endif // D_NOISECHANNELGRAPH
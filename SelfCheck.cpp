@@ -0,0 +1,417 @@
+
+// Checks the invariants the generator relies on: batched and grid noise identical to the scalar functions on every
+// backend the CPU supports, reproducible seeds and integer hash, half conversion, quantization and the round trip of
+// volume files and archives. Prints the failed checks and returns 1 if any, run by ctest.
+
+#include "TileableVolumeNoise.h"
+#include "TaskScheduler.h"
+#include "VolumeArchive.h"
+#include "VolumeFile.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace
+{
+	int gFailureCount = 0;
+
+	void Check(bool condition, const char* what, const char* context = "")
+	{
+		if (condition)
+			return;
+		printf("FAILED: %s %s\n", what, context);
+		gFailureCount++;
+	}
+
+	bool SameBits(const void* a, const void* b, size_t size)
+	{
+		return memcmp(a, b, size) == 0;
+	}
+
+	/// Deterministic xorshift, the checks must not depend on the standard library implementation.
+	struct Random
+	{
+		uint32_t state;
+
+		explicit Random(uint32_t seed) : state(seed) {}
+
+		uint32_t Next()
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state;
+		}
+
+		float NextFloat() { return float(Next() >> 8) * (1.0f / 16777216.0f); }
+	};
+
+	/// Points in [0, 1] including the corners and edges of the pattern.
+	struct Points
+	{
+		std::vector<float> x, y, z;
+
+		explicit Points(int count)
+		{
+			Random random(12345);
+			for (int i = 0; i < count; i++)
+			{
+				x.push_back(i < 8 ? float(i & 1) : random.NextFloat());
+				y.push_back(i < 8 ? float((i >> 1) & 1) : random.NextFloat());
+				z.push_back(i < 8 ? float(i >> 2) : random.NextFloat());
+			}
+		}
+
+		int size() const { return int(x.size()); }
+	};
+
+	void CheckWorleyBatch(const char* backend)
+	{
+		// 67 points so that every lane width also goes through its scalar tail
+		const Points points(67);
+		const int count = points.size();
+		std::vector<float> batch(count), scalar(count);
+
+		// Non integer and very large cell counts take the scalar fallback
+		const int seeds[] = { 0, 5, -3 };
+		for (float cellCount : { 1.0f, 3.0f, 7.5f, 16.0f, 200.0f })
+		{
+			for (int seed : seeds)
+			{
+				Tileable3dNoise::WorleyNoiseBatch(points.x.data(), points.y.data(), points.z.data(), batch.data(), count, cellCount, seed);
+				for (int i = 0; i < count; i++)
+					scalar[i] = Tileable3dNoise::WorleyNoise(glm::vec3(points.x[i], points.y[i], points.z[i]), cellCount, seed);
+				Check(SameBits(batch.data(), scalar.data(), count * sizeof(float)), "WorleyNoiseBatch == WorleyNoise", backend);
+			}
+
+			std::vector<float> seedBatch(count * 3);
+			Tileable3dNoise::WorleyNoiseBatchSeeds(points.x.data(), points.y.data(), points.z.data(), seedBatch.data(), count, cellCount, seeds, 3);
+			for (int k = 0; k < 3; k++)
+			{
+				Tileable3dNoise::WorleyNoiseBatch(points.x.data(), points.y.data(), points.z.data(), batch.data(), count, cellCount, seeds[k]);
+				Check(SameBits(&seedBatch[size_t(k) * count], batch.data(), count * sizeof(float)), "WorleyNoiseBatchSeeds == WorleyNoiseBatch", backend);
+			}
+		}
+	}
+
+	void CheckPerlinBatch(const char* backend)
+	{
+		const Points points(67);
+		const int count = points.size();
+		std::vector<float> batch(count), scalar(count);
+
+		// Several octaves so that the period of each one wraps
+		for (float frequency : { 1.0f, 4.0f, 6.0f })
+		{
+			for (int seed : { 0, 5, -3 })
+			{
+				Tileable3dNoise::PerlinNoise3dBatch(points.x.data(), points.y.data(), points.z.data(), batch.data(), count, frequency, 3, seed);
+				for (int i = 0; i < count; i++)
+					scalar[i] = Tileable3dNoise::PerlinNoise3d(glm::vec3(points.x[i], points.y[i], points.z[i]), frequency, 3, seed);
+				Check(SameBits(batch.data(), scalar.data(), count * sizeof(float)), "PerlinNoise3dBatch == PerlinNoise3d", backend);
+			}
+		}
+	}
+
+	void CheckHalfBatch(const char* backend)
+	{
+		// Every half is exactly representable, then values between them, out of range ones and NaNs
+		std::vector<float> floats;
+		for (int h = 0; h < 0x10000; h++)
+			floats.push_back(Tileable3dNoise::HalfToFloat((unsigned short)h));
+		Random random(777);
+		for (int i = 0; i < 4096; i++)
+		{
+			uint32_t bits = random.Next();
+			float value;
+			memcpy(&value, &bits, sizeof(value));
+			floats.push_back(value);
+		}
+		std::vector<unsigned short> halfBatch(floats.size()), halfScalar(floats.size());
+		Tileable3dNoise::FloatToHalfBatch(floats.data(), halfBatch.data(), int(floats.size()));
+		for (size_t i = 0; i < floats.size(); i++)
+			halfScalar[i] = Tileable3dNoise::FloatToHalf(floats[i]);
+		Check(halfBatch == halfScalar, "FloatToHalfBatch == FloatToHalf", backend);
+	}
+
+	void CheckHalf()
+	{
+		for (int h = 0; h < 0x10000; h++)
+		{
+			const bool nan = (h & 0x7C00) == 0x7C00 && (h & 0x3FF) != 0;
+			const unsigned short half = Tileable3dNoise::FloatToHalf(Tileable3dNoise::HalfToFloat((unsigned short)h));
+			if (nan ? (half & 0x7E00) != 0x7E00 : half != h)
+			{
+				Check(false, "FloatToHalf(HalfToFloat(h)) == h");
+				break;
+			}
+		}
+		Check(Tileable3dNoise::FloatToHalf(1.0f + 1.0f / 2048.0f) == 0x3C00, "FloatToHalf rounds half to even (down)");
+		Check(Tileable3dNoise::FloatToHalf(1.0f + 3.0f / 2048.0f) == 0x3C02, "FloatToHalf rounds half to even (up)");
+		Check(Tileable3dNoise::FloatToHalf(65520.0f) == 0x7C00, "FloatToHalf overflows to infinity");
+		Check(Tileable3dNoise::FloatToHalf(-65504.0f) == 0xFBFF, "FloatToHalf keeps the largest half");
+		Check(Tileable3dNoise::FloatToHalf(1.0e-8f) == 0x0000, "FloatToHalf underflows to zero");
+		Check(Tileable3dNoise::FloatToHalf(5.9604645e-8f) == 0x0001, "FloatToHalf keeps the smallest subnormal");
+	}
+
+	void CheckQuantization(Tileable3dNoise::Backend bestBackend)
+	{
+		// Values around and beyond [0, 1], with and without bias, compared with the scalar code
+		const int count = 67;
+		Random random(99);
+		std::vector<float> planes[4];
+		std::vector<float> bias(count);
+		for (int i = 0; i < count; i++)
+		{
+			for (std::vector<float>& plane : planes)
+				plane.push_back(random.NextFloat() * 1.2f - 0.1f);
+			bias[i] = random.NextFloat() - 0.5f;
+		}
+		const float* planePtrs[4] = { planes[0].data(), planes[1].data(), planes[2].data(), planes[3].data() };
+
+		for (int channelCount : { 1, 4 })
+		{
+			for (int variant = 0; variant < 4; variant++)
+			{
+				const float* variantBias = variant & 1 ? bias.data() : nullptr;
+				const bool round = (variant & 2) != 0;
+				std::vector<unsigned char> expected(size_t(count) * channelCount), actual(expected.size());
+				Tileable3dNoise::SetBackend(Tileable3dNoise::Backend::Scalar);
+				Tileable3dNoise::QuantizeUnorm8Batch(planePtrs, channelCount, count, variantBias, round, expected.data());
+				for (int b = 1; b <= int(bestBackend); b++)
+				{
+					const Tileable3dNoise::Backend backend = Tileable3dNoise::SetBackend(Tileable3dNoise::Backend(b));
+					Tileable3dNoise::QuantizeUnorm8Batch(planePtrs, channelCount, count, variantBias, round, actual.data());
+					Check(actual == expected, "QuantizeUnorm8Batch == scalar", Tileable3dNoise::GetBackendName(backend));
+				}
+			}
+		}
+
+		Tileable3dNoise::SetBackend(Tileable3dNoise::Backend::Scalar);
+		const float values[] = { 0.0f, 1.0f, 0.5f, -1.0f, 2.0f };
+		const float* valuePlane = values;
+		unsigned char truncated[5], rounded[5];
+		Tileable3dNoise::QuantizeUnorm8Batch(&valuePlane, 1, 5, nullptr, false, truncated);
+		Tileable3dNoise::QuantizeUnorm8Batch(&valuePlane, 1, 5, nullptr, true, rounded);
+		const unsigned char expectedTruncated[5] = { 0, 255, 127, 0, 255 };
+		const unsigned char expectedRounded[5] = { 0, 255, 128, 0, 255 };
+		Check(SameBits(truncated, expectedTruncated, 5), "QuantizeUnorm8Batch truncates");
+		Check(SameBits(rounded, expectedRounded, 5), "QuantizeUnorm8Batch rounds half to even");
+	}
+
+	/// FNV-1a of the Worley noise of a fixed set of points.
+	uint64_t HashWorley(float cellCount, int seed = 0)
+	{
+		const Points points(256);
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (int i = 0; i < points.size(); i++)
+		{
+			const float value = Tileable3dNoise::WorleyNoise(glm::vec3(points.x[i], points.y[i], points.z[i]), cellCount, seed);
+			unsigned char bytes[sizeof(float)];
+			memcpy(bytes, &value, sizeof(value));
+			for (unsigned char byte : bytes)
+				hash = (hash ^ byte) * 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	void CheckIntegerHash()
+	{
+		// The integer hash is bit reproducible on every platform
+		Tileable3dNoise::SetHash(Tileable3dNoise::Hash::Integer);
+		Check(HashWorley(4.0f) == 0x456bcaf073c06912ull, "integer hash gives the reference values for 4 cells");
+		Check(HashWorley(7.0f) == 0x8be6fec6223efd66ull, "integer hash gives the reference values for 7 cells");
+		Tileable3dNoise::SetHash(Tileable3dNoise::Hash::Sin);
+	}
+
+	void CheckSeeds()
+	{
+		const glm::vec3 p(0.3f, 0.6f, 0.9f);
+		for (Tileable3dNoise::Hash hash : { Tileable3dNoise::Hash::Sin, Tileable3dNoise::Hash::Integer })
+		{
+			Tileable3dNoise::SetHash(hash);
+			const char* name = hash == Tileable3dNoise::Hash::Sin ? "sin" : "integer";
+			Check(Tileable3dNoise::WorleyNoise(p, 4.0f) == Tileable3dNoise::WorleyNoise(p, 4.0f, 0), "seed 0 is the default", name);
+			Check(HashWorley(4.0f, 7) == HashWorley(4.0f, 7), "seeds are reproducible", name);
+			Check(HashWorley(4.0f, 7) != HashWorley(4.0f, 8), "seeds differ", name);
+			Check(HashWorley(4.0f, 16777216) != HashWorley(4.0f, 16777217), "large seeds differ", name);
+
+			// Enough seeds to evict the cached table of seed 7, which is then built again
+			const uint64_t before = HashWorley(4.0f, 7);
+			for (int seed = 100; seed < 400; seed++)
+				Tileable3dNoise::WorleyNoise(p, 4.0f, seed);
+			Check(HashWorley(4.0f, 7) == before, "seeds are reproducible once evicted", name);
+		}
+		Tileable3dNoise::SetHash(Tileable3dNoise::Hash::Integer);
+		Check(HashWorley(7.0f, 42) == 0x1f61e114dec94f7eull, "integer hash gives the reference values for seed 42");
+		Tileable3dNoise::SetHash(Tileable3dNoise::Hash::Sin);
+
+		Check(Tileable3dNoise::PerlinNoise3d(p, 4.0f, 3, 2) == Tileable3dNoise::PerlinNoise3d(p, 4.0f, 3, 2), "Perlin seeds are reproducible");
+		Check(Tileable3dNoise::PerlinNoise3d(p, 4.0f, 3, 2) != Tileable3dNoise::PerlinNoise3d(p, 4.0f, 3, 3), "Perlin seeds differ");
+	}
+
+	void CheckGrid(const char* backend)
+	{
+		const int gridSize = 24;
+		const glm::ivec3 begin(3, 0, 5), end(21, 24, 9);
+		const glm::ivec3 extent = end - begin;
+		const glm::vec3 normFact(1.0f / float(gridSize));		// like the volumes of NoiseChannelGraph
+		std::vector<float> grid(size_t(extent.x) * extent.y * extent.z);
+		for (float cellCount : { 2.0f, 5.0f, 6.5f })
+		{
+			for (int seed : { 0, 11 })
+			{
+				Tileable3dNoise::WorleyNoiseGrid(gridSize, begin, end, cellCount, grid.data(), seed);
+				bool same = true;
+				size_t v = 0;
+				for (int r = begin.z; r < end.z; r++)
+					for (int t = begin.y; t < end.y; t++)
+						for (int s = begin.x; s < end.x; s++, v++)
+						{
+							const float expected = Tileable3dNoise::WorleyNoise(glm::vec3(s, t, r) * normFact, cellCount, seed);
+							same = same && SameBits(&grid[v], &expected, sizeof(float));
+						}
+				Check(same, "WorleyNoiseGrid == WorleyNoise", backend);
+			}
+		}
+	}
+	/// Texels of a size^3 volume with smooth and random channels, so that both the LZ matches and literals are used.
+	std::vector<uint8_t> MakeTexels(int size, size_t texelSize)
+	{
+		std::vector<uint8_t> texels(size_t(size) * size * size * texelSize);
+		Random random(31);
+		for (size_t i = 0; i < texels.size(); i++)
+			texels[i] = i % 3 == 0 ? uint8_t(random.Next()) : uint8_t(i / texelSize / 7);
+		return texels;
+	}
+
+	void CheckVolumeFile()
+	{
+		const char* fileName = "SelfCheck.vol";
+		const int size = 13;
+		const std::vector<uint8_t> texels = MakeTexels(size, 4 * sizeof(uint16_t));
+		const size_t sliceBytes = texels.size() / size;
+
+		VolumeFile::Writer writer;
+		bool written = writer.Begin(fileName, size, 4, VolumeFile::ElementType::Half, "self check");
+		written = written && writer.WriteSlices(5, texels.data()) && writer.WriteSlices(size - 5, texels.data() + 5 * sliceBytes);
+		written = writer.End() && written;
+		Check(written, "VolumeFile::Writer");
+
+		VolumeFile file;
+		std::string error;
+		if (!file.Open(fileName, error))
+		{
+			Check(false, "VolumeFile::Open", error.c_str());
+		}
+		else
+		{
+			const VolumeFile::View<uint16_t> view = file.GetView<uint16_t>();
+			Check(!view.empty() && file.GetView<float>().empty(), "VolumeFile::GetView checks the element type");
+			Check(!view.empty() && SameBits(view.texels, texels.data(), texels.size()), "VolumeFile round trip");
+			Check(file.VerifyHash(), "VolumeFile::VerifyHash");
+			Check(strcmp(file.GetHeader().parameters, "self check") == 0, "VolumeFile parameters");
+		}
+		file.Close();
+		remove(fileName);
+	}
+
+	void CheckVolumeArchive(TaskScheduler& scheduler)
+	{
+		const char* fileName = "SelfCheck.varc";
+		const int size = 21;
+		for (VolumeFile::ElementType elementType : { VolumeFile::ElementType::Unorm8, VolumeFile::ElementType::Float })
+		{
+			for (int channelCount : { 1, 4 })
+			{
+				const size_t texelSize = channelCount * VolumeFile::GetElementSize(elementType);
+				const std::vector<uint8_t> texels = MakeTexels(size, texelSize);
+				for (int brickSize : { 7, 16, 32 })
+				{
+					for (VolumeArchive::Filter filter : { VolumeArchive::Filter::None, VolumeArchive::Filter::Delta })
+					{
+						char context[64];
+						snprintf(context, sizeof(context), "(%d channels of %d bytes, %d^3 bricks, filter %d)", channelCount,
+							int(VolumeFile::GetElementSize(elementType)), brickSize, int(filter));
+
+						VolumeArchive::Writer writer;
+						const size_t sliceBytes = texels.size() / size;
+						bool written = writer.Begin(fileName, size, channelCount, elementType, brickSize, filter, "");
+						written = written && writer.WriteSlices(scheduler, 9, texels.data())
+							&& writer.WriteSlices(scheduler, size - 9, texels.data() + 9 * sliceBytes);
+						written = writer.End() && written;
+						Check(written, "VolumeArchive::Writer", context);
+
+						VolumeArchive::Reader reader;
+						std::string error;
+						if (!reader.Open(fileName, error))
+						{
+							Check(false, "VolumeArchive::Reader::Open", error.c_str());
+							continue;
+						}
+						std::vector<uint8_t> volume;
+						Check(reader.ReadVolume(scheduler, volume) && volume == texels, "VolumeArchive volume round trip", context);
+						Check(VolumeFile::Hash(volume.data(), volume.size()) == reader.GetHeader().volumeHash, "VolumeArchive hash", context);
+
+						// The last brick is clipped by the volume edges when the size is not a multiple of the brick size
+						const uint32_t* brickCounts = reader.GetHeader().brickCounts;
+						const int x = int(brickCounts[0]) - 1, y = int(brickCounts[1]) / 2, z = int(brickCounts[2]) - 1;
+						const Range3d range = reader.GetBrickRange(x, y, z);
+						std::vector<uint8_t> brick;
+						bool same = reader.ReadBrick(x, y, z, brick) && brick.size() == range.volume() * texelSize;
+						size_t i = 0;
+						for (int r = range.begin.z; r < range.end.z && same; r++)
+							for (int t = range.begin.y; t < range.end.y && same; t++)
+								for (int s = range.begin.x; s < range.end.x && same; s++, i++)
+									same = SameBits(&brick[i * texelSize], &texels[((size_t(r) * size + t) * size + s) * texelSize], texelSize);
+						Check(same, "VolumeArchive brick round trip", context);
+					}
+				}
+			}
+		}
+
+		VolumeArchive::Writer writer;
+		Check(!writer.Begin(fileName, 1024, 4, VolumeFile::ElementType::Float, 700, VolumeArchive::Filter::None, ""),
+			"VolumeArchive::Writer rejects bricks over 4 GiB");
+		remove(fileName);
+	}
+}
+
+int main()
+{
+	const Tileable3dNoise::Backend bestBackend = Tileable3dNoise::GetBestSupportedBackend();
+	for (int b = 0; b <= int(bestBackend); b++)
+	{
+		const Tileable3dNoise::Backend backend = Tileable3dNoise::SetBackend(Tileable3dNoise::Backend(b));
+		printf("Checking the %s backend\n", Tileable3dNoise::GetBackendName(backend));
+		for (Tileable3dNoise::Hash hash : { Tileable3dNoise::Hash::Sin, Tileable3dNoise::Hash::Integer })
+		{
+			Tileable3dNoise::SetHash(hash);
+			CheckWorleyBatch(Tileable3dNoise::GetBackendName(backend));
+			CheckGrid(Tileable3dNoise::GetBackendName(backend));
+		}
+		Tileable3dNoise::SetHash(Tileable3dNoise::Hash::Sin);
+		CheckPerlinBatch(Tileable3dNoise::GetBackendName(backend));
+		CheckHalfBatch(Tileable3dNoise::GetBackendName(backend));
+	}
+	CheckQuantization(bestBackend);
+	Tileable3dNoise::SetBackend(bestBackend);
+	CheckIntegerHash();
+	CheckSeeds();
+	CheckHalf();
+
+	CheckVolumeFile();
+	TaskScheduler scheduler(4);
+	CheckVolumeArchive(scheduler);
+
+	if (gFailureCount > 0)
+	{
+		printf("%d checks failed\n", gFailureCount);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,368 @@
+
+#include "TaskScheduler.h"
+
+#include "glm/common.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	double ToMs(Clock::duration d)
+	{
+		return std::chrono::duration<double, std::milli>(d).count();
+	}
+
+	// Scheduler and thread index of the worker threads, used to push nested work to the right queue
+	thread_local const void* tCurrentScheduler = nullptr;
+	thread_local int tCurrentThread = 0;
+
+	// Xorshift state of each thread, picks the first queue to steal from
+	thread_local uint32_t tStealState = 0;
+
+	uint32_t NextStealRandom(int thread)
+	{
+		if (tStealState == 0)
+			tStealState = 0x9E3779B9u * uint32_t(thread + 1);
+		tStealState ^= tStealState << 13;
+		tStealState ^= tStealState >> 17;
+		tStealState ^= tStealState << 5;
+		return tStealState;
+	}
+}
+
+struct TaskScheduler::Job
+{
+	// ParallelFor3d
+	Range3d range;
+	glm::ivec3 blockSize;
+	glm::ivec3 blockCount;
+	const std::function<void(const Range3d&)>* func;
+
+	// Run of a TaskGraph, remaining dependencies of each task
+	const TaskGraph* graph;
+	std::unique_ptr<std::atomic<int>[]> dependencyCounts;
+
+	Clock::time_point start;
+	std::atomic<int> remaining;
+	std::vector<TaskTiming> timings;
+
+	Job() : func(nullptr), graph(nullptr) {}
+
+	Range3d GetBlock(int index) const
+	{
+		const glm::ivec3 block(index % blockCount.x, (index / blockCount.x) % blockCount.y, index / (blockCount.x * blockCount.y));
+		const glm::ivec3 begin = range.begin + block * blockSize;
+		return Range3d(begin, glm::min(begin + blockSize, range.end));
+	}
+};
+
+
+
+TaskScheduler::TaskScheduler(int threadCount)
+	: mThreadCount(threadCount)
+	, mQueuedTaskCount(0)
+	, mSleepingCount(0)
+	, mQuit(false)
+{
+	if (mThreadCount <= 0)
+		mThreadCount = std::max(1, int(std::thread::hardware_concurrency()));
+
+	mQueues.reset(new TaskQueue[mThreadCount]);
+	for (int t = 1; t < mThreadCount; t++)
+		mThreads.emplace_back(&TaskScheduler::WorkerMain, this, t);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mQuit = true;
+	}
+	mSleepCondition.notify_all();
+	for (std::thread& thread : mThreads)
+		thread.join();
+}
+
+int TaskScheduler::GetCurrentThreadIndex() const
+{
+	// Threads external to the pool share queue 0
+	return tCurrentScheduler == this ? tCurrentThread : 0;
+}
+
+void TaskScheduler::WorkerMain(int thread)
+{
+	tCurrentScheduler = this;
+	tCurrentThread = thread;
+
+	while (true)
+	{
+		Task task;
+		bool stolen;
+		if (PopOrSteal(thread, task, stolen))
+		{
+			Run(task, thread, stolen);
+			continue;
+		}
+
+		Sleep([this]() { return mQuit || mQueuedTaskCount.load() > 0; });
+		if (mQuit)
+			return;
+	}
+}
+
+bool TaskScheduler::PopOrSteal(int thread, Task& task, bool& stolen)
+{
+	if (mQueuedTaskCount.load() == 0)
+		return false;
+
+	// Own work is taken in order from the front, stolen work from the back to stay away from the owner
+	stolen = false;
+	if (Take(mQueues[thread], task, true))
+		return true;
+
+	// Idle threads start from different victims rather than all contending on the next queue
+	stolen = true;
+	const int victimCount = mThreadCount - 1;
+	const int first = victimCount > 0 ? int(NextStealRandom(thread) % uint32_t(victimCount)) : 0;
+	for (int i = 0; i < victimCount; i++)
+	{
+		const int victim = (thread + 1 + (first + i) % victimCount) % mThreadCount;
+		if (Take(mQueues[victim], task, false))
+			return true;
+	}
+	return false;
+}
+
+bool TaskScheduler::Take(TaskQueue& queue, Task& task, bool front)
+{
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.tasks.empty())
+		return false;
+	if (front)
+	{
+		task = queue.tasks.front();
+		queue.tasks.pop_front();
+	}
+	else
+	{
+		task = queue.tasks.back();
+		queue.tasks.pop_back();
+	}
+	mQueuedTaskCount--;
+	return true;
+}
+
+void TaskScheduler::Wake(int taskCount)
+{
+	// Called after the change the sleeping threads wait for. Sleep counts a thread in before checking its condition and
+	// both sides are sequentially consistent, so either the thread sees the change or it is counted here. Locking then
+	// guarantees that it is waiting on the condition variable when notified.
+	const int sleepingCount = mSleepingCount.load();
+	if (sleepingCount == 0 || taskCount <= 0)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+	}
+	// One sleeping thread per task, the others keep sleeping
+	if (taskCount >= sleepingCount)
+	{
+		mSleepCondition.notify_all();
+		return;
+	}
+	for (int i = 0; i < taskCount; i++)
+		mSleepCondition.notify_one();
+}
+
+void TaskScheduler::Sleep(const std::function<bool()>& wakeCondition)
+{
+	std::unique_lock<std::mutex> lock(mSleepMutex);
+	mSleepingCount++;
+	mSleepCondition.wait(lock, wakeCondition);
+	mSleepingCount--;
+}
+
+void TaskScheduler::Run(const Task& task, int thread, bool stolen)
+{
+	Job& job = *task.job;
+	const Range3d block = job.graph ? job.graph->mNodes[task.index].block : job.GetBlock(task.index);
+
+	const Clock::time_point start = Clock::now();
+	if (job.graph)
+		job.graph->mNodes[task.index].func();
+	else
+		(*job.func)(block);
+	const Clock::time_point end = Clock::now();
+
+	TaskTiming& timing = job.timings[task.index];
+	timing.block = block;
+	timing.thread = thread;
+	timing.stolen = stolen;
+	timing.startMs = ToMs(start - job.start);
+	timing.durationMs = ToMs(end - start);
+
+	if (job.graph)
+	{
+		// Successors whose last dependency this was are queued on this thread
+		std::vector<int> ready;
+		for (int successor : job.graph->mNodes[task.index].successors)
+		{
+			if (job.dependencyCounts[successor].fetch_sub(1, std::memory_order_acq_rel) == 1)
+				ready.push_back(successor);
+		}
+		if (!ready.empty())
+		{
+			{
+				std::lock_guard<std::mutex> lock(mQueues[thread].mutex);
+				for (int successor : ready)
+					mQueues[thread].tasks.push_front({ &job, successor });
+			}
+			mQueuedTaskCount += int(ready.size());
+			// This thread takes the first one next
+			Wake(int(ready.size()) - 1);
+		}
+	}
+
+	if (job.remaining.fetch_sub(1) == 1)
+	{
+		// The thread waiting on the job may be asleep, among others waiting for tasks
+		Wake(mThreadCount);
+	}
+}
+
+TaskTimings TaskScheduler::ParallelFor3d(const Range3d& range, const glm::ivec3& blockSize, const std::function<void(const Range3d&)>& func)
+{
+	Job job;
+	job.range = range;
+	job.blockSize = glm::max(blockSize, glm::ivec3(1));
+	job.blockCount = glm::max((range.size() + job.blockSize - glm::ivec3(1)) / job.blockSize, glm::ivec3(0));
+	job.func = &func;
+	job.start = Clock::now();
+
+	const int taskCount = job.blockCount.x * job.blockCount.y * job.blockCount.z;
+	job.remaining = taskCount;
+	job.timings.resize(taskCount);
+
+	std::vector<int> tasks(taskCount);
+	for (int i = 0; i < taskCount; i++)
+		tasks[i] = i;
+	const int thread = GetCurrentThreadIndex();
+	Push(job, tasks.data(), taskCount, thread);
+	return Wait(job, thread);
+}
+
+TaskTimings TaskScheduler::Run(const TaskGraph& graph)
+{
+	Job job;
+	job.graph = &graph;
+	job.start = Clock::now();
+
+	const int taskCount = graph.GetTaskCount();
+	job.remaining = taskCount;
+	job.timings.resize(taskCount);
+	job.dependencyCounts.reset(new std::atomic<int>[taskCount]);
+	std::vector<int> tasks;
+	for (int i = 0; i < taskCount; i++)
+	{
+		job.dependencyCounts[i] = graph.mNodes[i].dependencyCount;
+		if (graph.mNodes[i].dependencyCount == 0)
+			tasks.push_back(i);
+	}
+
+	const int thread = GetCurrentThreadIndex();
+	Push(job, tasks.data(), int(tasks.size()), thread);
+	return Wait(job, thread);
+}
+
+void TaskScheduler::Push(Job& job, const int* tasks, int taskCount, int thread)
+{
+	// Contiguous runs of tasks go to each queue, starting with the calling thread
+	for (int q = 0; q < mThreadCount; q++)
+	{
+		const int first = int((long long)taskCount * q / mThreadCount);
+		const int last = int((long long)taskCount * (q + 1) / mThreadCount);
+		if (first == last)
+			continue;
+		TaskQueue& queue = mQueues[(thread + q) % mThreadCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		for (int i = first; i < last; i++)
+			queue.tasks.push_back({ &job, tasks[i] });
+	}
+	mQueuedTaskCount += taskCount;
+	// The calling thread runs tasks too while it waits
+	Wake(taskCount - 1);
+}
+
+TaskTimings TaskScheduler::Wait(Job& job, int thread)
+{
+	// Help until all tasks of the job have completed, possibly running tasks of other jobs
+	while (job.remaining.load(std::memory_order_acquire) > 0)
+	{
+		Task task;
+		bool stolen;
+		if (PopOrSteal(thread, task, stolen))
+		{
+			Run(task, thread, stolen);
+			continue;
+		}
+
+		// Nothing left to run here, sleeps until more tasks are queued or the last ones complete on other threads
+		Sleep([this, &job]() { return job.remaining.load() == 0 || mQueuedTaskCount.load() > 0; });
+	}
+
+	TaskTimings timings;
+	timings.threadCount = mThreadCount;
+	timings.wallMs = ToMs(Clock::now() - job.start);
+	timings.tasks.swap(job.timings);
+	return timings;
+}
+
+
+
+int TaskGraph::AddTask(const std::function<void()>& func, const Range3d& block)
+{
+	Node node;
+	node.func = func;
+	node.block = block;
+	node.dependencyCount = 0;
+	mNodes.push_back(node);
+	return int(mNodes.size()) - 1;
+}
+
+void TaskGraph::AddDependency(int dependency, int task)
+{
+	mNodes[dependency].successors.push_back(task);
+	mNodes[task].dependencyCount++;
+}
+
+
+
+void TaskTimings::Print(const char* label) const
+{
+	int stolenCount = 0;
+	double minMs = tasks.empty() ? 0.0 : tasks[0].durationMs;
+	double maxMs = 0.0;
+	double sumMs = 0.0;
+	std::vector<double> busyMs(threadCount, 0.0);
+	std::vector<int> taskCount(threadCount, 0);
+	for (const TaskTiming& task : tasks)
+	{
+		stolenCount += task.stolen ? 1 : 0;
+		minMs = std::min(minMs, task.durationMs);
+		maxMs = std::max(maxMs, task.durationMs);
+		sumMs += task.durationMs;
+		busyMs[task.thread] += task.durationMs;
+		taskCount[task.thread]++;
+	}
+
+	printf("%s: %.2f ms wall, %d tasks (%d stolen) on %d threads, task min/avg/max %.3f/%.3f/%.3f ms\n",
+		label, wallMs, int(tasks.size()), stolenCount, threadCount, minMs, tasks.empty() ? 0.0 : sumMs / tasks.size(), maxMs);
+	for (int t = 0; t < threadCount; t++)
+	{
+		printf("  thread %3d: %5d tasks, busy %8.2f ms (%5.1f%%)\n", t, taskCount[t], busyMs[t], wallMs > 0.0 ? 100.0 * busyMs[t] / wallMs : 0.0);
+	}
+}
@@ -0,0 +1,148 @@
+#ifndef D_TASKSCHEDULER
+#define D_TASKSCHEDULER
+
+#include "glm/vec3.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Half open 3d range of integer coordinates [begin, end).
+struct Range3d
+{
+	glm::ivec3 begin;
+	glm::ivec3 end;
+
+	Range3d() : begin(0), end(0) {}
+	Range3d(const glm::ivec3& b, const glm::ivec3& e) : begin(b), end(e) {}
+
+	glm::ivec3 size() const { return end - begin; }
+	int volume() const { glm::ivec3 s = size(); return s.x * s.y * s.z; }
+};
+
+/// Timing of one task run by TaskScheduler::ParallelFor3d.
+struct TaskTiming
+{
+	Range3d block;
+	int thread;					///< Index of the thread that ran the task, 0 being the thread that called ParallelFor3d.
+	bool stolen;				///< Whether the task was stolen from the queue of another thread.
+	double startMs;				///< Relative to the start of the ParallelFor3d call.
+	double durationMs;
+};
+
+/// Per task timing breakdown of a TaskScheduler::ParallelFor3d call.
+struct TaskTimings
+{
+	int threadCount;
+	double wallMs;
+	std::vector<TaskTiming> tasks;
+
+	TaskTimings() : threadCount(0), wallMs(0.0) {}
+
+	/// Prints the wall time, the busy time of each thread and the task duration spread.
+	void Print(const char* label) const;
+};
+
+///
+/// Tasks and the dependencies between them, run by TaskScheduler::Run. The graph must not have cycles.
+///
+class TaskGraph
+{
+public:
+
+	/// @param block only reported in the timings of the task.
+	/// @return the index of the task.
+	int AddTask(const std::function<void()>& func, const Range3d& block = Range3d());
+
+	/// task will only start once dependency has completed.
+	void AddDependency(int dependency, int task);
+
+	int GetTaskCount() const { return int(mNodes.size()); }
+
+private:
+
+	friend class TaskScheduler;
+
+	struct Node
+	{
+		std::function<void()> func;
+		Range3d block;
+		std::vector<int> successors;
+		int dependencyCount;
+	};
+
+	std::vector<Node> mNodes;
+};
+
+///
+/// Fixed pool of threads with one task deque per thread. A thread pops from the front of its own deque and
+/// steals from the back of the other ones when it runs out of work, starting from a random victim. The thread
+/// waiting on a ParallelFor3d runs tasks too, so calls can be nested from within a task. Threads without work,
+/// including waiting ones, sleep until tasks are queued. Queuing tasks only takes the sleep lock when threads are
+/// asleep, then wakes as many of them as there are new tasks at once.
+///
+class TaskScheduler
+{
+public:
+
+	/// @param threadCount number of threads running tasks, including the calling thread. 0 uses all hardware threads.
+	explicit TaskScheduler(int threadCount = 0);
+	~TaskScheduler();
+
+	int GetThreadCount() const { return mThreadCount; }
+
+	/// Runs func on every block of at most blockSize tiling range, in parallel, and returns once all have completed.
+	/// @return the timing of each task.
+	TaskTimings ParallelFor3d(const Range3d& range, const glm::ivec3& blockSize, const std::function<void(const Range3d&)>& func);
+
+	/// Runs the tasks of graph in parallel, each one as soon as its dependencies have completed, and returns once all
+	/// have completed. A task made ready by another one goes to the queue of the thread that ran it.
+	/// @return the timing of each task, in the order they were added.
+	TaskTimings Run(const TaskGraph& graph);
+
+private:
+
+	struct Job;
+
+	struct Task
+	{
+		Job* job;
+		int index;
+	};
+
+	struct TaskQueue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+		char padding[64];		// keeps the queues of different threads on different cache lines
+	};
+
+	TaskScheduler(const TaskScheduler&) = delete;
+	TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+	void WorkerMain(int thread);
+	bool PopOrSteal(int thread, Task& task, bool& stolen);
+	bool Take(TaskQueue& queue, Task& task, bool front);
+	void Wake(int taskCount);
+	void Sleep(const std::function<bool()>& wakeCondition);
+	void Run(const Task& task, int thread, bool stolen);
+	void Push(Job& job, const int* tasks, int taskCount, int thread);
+	TaskTimings Wait(Job& job, int thread);
+	int GetCurrentThreadIndex() const;
+
+	int mThreadCount;
+	std::vector<std::thread> mThreads;
+	std::unique_ptr<TaskQueue[]> mQueues;
+	std::atomic<int> mQueuedTaskCount;
+	std::atomic<int> mSleepingCount;		///< Threads in Sleep, only changed with mSleepMutex locked.
+	std::atomic<bool> mQuit;
+	std::mutex mSleepMutex;
+	std::condition_variable mSleepCondition;
+};
+
+#endif // D_TASKSCHEDULER
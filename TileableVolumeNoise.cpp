@@ -1,52 +1,227 @@
 
 #include "TileableVolumeNoise.h"
 
-#include "glm\gtc\noise.hpp"
+#include "glm/gtc/noise.hpp"
 #include <math.h>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <vector>
 
 // Perlin noise based on GLM http://glm.g-truc.net
 // Worley noise based on https://www.shadertoy.com/view/Xl2XRR by Marc-Andre Loyer
 
+namespace
+{
+	std::atomic<int> gHash(int(Tileable3dNoise::Hash::Sin));
+}
+
+Tileable3dNoise::Hash Tileable3dNoise::GetHash()
+{
+	return Hash(gHash.load(std::memory_order_relaxed));
+}
+
+void Tileable3dNoise::SetHash(Hash hash)
+{
+	gHash.store(int(hash), std::memory_order_relaxed);
+}
+
 float Tileable3dNoise::hash(float n)
 {
 	return glm::fract(sin(n+1.951f) * 43758.5453f);
 }
 
+float Tileable3dNoise::integerHash(int x, int y, int z, int seed)
+{
+	// Lattice coordinates combined with large odd constants then mixed with a PCG output permutation
+	unsigned int h = unsigned(x) * 0x8da6b343u ^ unsigned(y) * 0xd8163841u ^ unsigned(z) * 0xcb1ab31fu ^ unsigned(seed) * 0x9e3779b9u;
+	h = h * 747796405u + 2891336453u;
+	h = ((h >> ((h >> 28u) + 4u)) ^ h) * 277803737u;
+	h = (h >> 22u) ^ h;
+	return float(h >> 8) * (1.0f / 16777216.0f);	// 24 bits, exact in [0, 1)
+}
+
 // hash based 3d value noise
-float Tileable3dNoise::noise(const glm::vec3& x)
+float Tileable3dNoise::noise(const glm::vec3& x, int seed)
 {
 	glm::vec3 p = glm::floor(x);
 	glm::vec3 f = glm::fract(x);
 
 	f = f*f*(glm::vec3(3.0f) - glm::vec3(2.0f) * f);
-	float n = p.x + p.y*57.0f + 113.0f*p.z;
+	float c[8];
+	if (GetHash() == Hash::Integer)
+	{
+		const glm::ivec3 i(p);
+		for (int k = 0; k < 8; k++)
+			c[k] = integerHash(i.x + (k & 1), i.y + ((k >> 1) & 1), i.z + (k >> 2), seed);
+	}
+	else
+	{
+		// The seed moves the lattice by a mixed integer offset of up to 1023 cells per axis, 0 for seed 0. n stays an
+		// integer well within the exact range of floats whatever the seed.
+		unsigned int h = unsigned(seed) * 0x9e3779b9u;
+		h = seed != 0 ? ((h >> 16u) ^ h) * 0x45d9f3bu : 0u;
+		const glm::vec3 q = p + glm::vec3(float(h & 1023u), float((h >> 10u) & 1023u), float((h >> 20u) & 1023u));
+		float n = q.x + q.y*57.0f + 113.0f*q.z;
+		c[0] = hash(n + 0.0f);		c[1] = hash(n + 1.0f);
+		c[2] = hash(n + 57.0f);		c[3] = hash(n + 58.0f);
+		c[4] = hash(n + 113.0f);	c[5] = hash(n + 114.0f);
+		c[6] = hash(n + 170.0f);	c[7] = hash(n + 171.0f);
+	}
 	return glm::mix(
 		glm::mix(
-			glm::mix(hash(n + 0.0f), hash(n + 1.0f), f.x),
-			glm::mix(hash(n + 57.0f), hash(n + 58.0f), f.x),
+			glm::mix(c[0], c[1], f.x),
+			glm::mix(c[2], c[3], f.x),
 			f.y),
 		glm::mix(
-			glm::mix(hash(n + 113.0f), hash(n + 114.0f), f.x),
-			glm::mix(hash(n + 170.0f), hash(n + 171.0f), f.x),
+			glm::mix(c[4], c[5], f.x),
+			glm::mix(c[6], c[7], f.x),
 			f.y),
 		f.z);
 }
 
-float Tileable3dNoise::Cells(const glm::vec3& p, float cellCount)
+const float* Tileable3dNoise::GetCellTable(int cellCount, int seed, CellTableHold* hold)
+{
+	// One set of tables per hash function. Tables of seed 0 are looked up without locking and kept for the whole run.
+	// Other seeds go through a per thread cache of the last table used, then a least recently used list bounded to
+	// MaxSeededCellTableBytes and MaxSeededCellTableCount. Evicted tables are freed once the last thread caching or holding them lets them go.
+	static std::atomic<const float*> cellTables[HashCount][MaxCellTableCount + 1];
+	static std::vector<float> cellTablesStorage[HashCount][MaxCellTableCount + 1];
+	struct SeededTable { int hashIndex, cellCount, seed; CellTableHold table; };
+	static std::list<SeededTable> seededTables;		// most recently used first
+	static size_t seededTableBytes = 0;
+	static std::mutex cellTablesMutex;
+	static thread_local SeededTable lastSeededTable = { -1, 0, 0, nullptr };
+
+	if (cellCount <= 0 || cellCount > MaxCellTableCount)
+		return nullptr;
+
+	const int hashIndex = int(GetHash());
+	const float* table = nullptr;
+	if (seed == 0)
+	{
+		table = cellTables[hashIndex][cellCount].load(std::memory_order_acquire);
+		if (table)
+			return table;
+	}
+	else if (lastSeededTable.hashIndex == hashIndex && lastSeededTable.cellCount == cellCount && lastSeededTable.seed == seed)
+	{
+		if (hold)
+			*hold = lastSeededTable.table;
+		return lastSeededTable.table->data();
+	}
+
+	std::lock_guard<std::mutex> lock(cellTablesMutex);
+	std::vector<float>* storagePtr;
+	std::shared_ptr<std::vector<float>> seededStorage;
+	if (seed == 0)
+	{
+		table = cellTables[hashIndex][cellCount].load(std::memory_order_relaxed);
+		if (table)
+			return table;
+		storagePtr = &cellTablesStorage[hashIndex][cellCount];
+	}
+	else
+	{
+		for (std::list<SeededTable>::iterator it = seededTables.begin(); it != seededTables.end(); ++it)
+		{
+			if (it->hashIndex == hashIndex && it->cellCount == cellCount && it->seed == seed)
+			{
+				seededTables.splice(seededTables.begin(), seededTables, it);
+				lastSeededTable = *it;
+				if (hold)
+					*hold = it->table;
+				return it->table->data();
+			}
+		}
+		seededStorage = std::make_shared<std::vector<float>>();
+		storagePtr = seededStorage.get();
+	}
+
+	// noise() evaluated on an integer lattice point has no fractional part so it reduces to the hash of the point
+	std::vector<float>& storage = *storagePtr;
+	storage.resize(size_t(cellCount) * cellCount * cellCount);
+	for (int z = 0; z < cellCount; z++)
+	{
+		for (int y = 0; y < cellCount; y++)
+		{
+			for (int x = 0; x < cellCount; x++)
+			{
+				storage[(z*cellCount + y)*cellCount + x] = noise(glm::vec3(float(x), float(y), float(z)), seed);
+			}
+		}
+	}
+	table = storage.data();
+	if (seed == 0)
+	{
+		cellTables[hashIndex][cellCount].store(table, std::memory_order_release);
+		return table;
+	}
+
+	const SeededTable entry = { hashIndex, cellCount, seed, seededStorage };
+	seededTables.push_front(entry);
+	seededTableBytes += storage.size() * sizeof(float);
+	while ((seededTableBytes > MaxSeededCellTableBytes || seededTables.size() > MaxSeededCellTableCount) && seededTables.size() > 1)
+	{
+		seededTableBytes -= seededTables.back().table->size() * sizeof(float);
+		seededTables.pop_back();
+	}
+	lastSeededTable = entry;
+	if (hold)
+		*hold = entry.table;
+	return table;
+}
+
+float Tileable3dNoise::Cells(const glm::vec3& p, float cellCount, int seed)
 {
 	const glm::vec3 pCell = p * cellCount;
 	float d = 1.0e10;
-	for (int xo = -1; xo <= 1; xo++)
+
+	const int cellCountInt = int(cellCount);
+	const float* cellTable = float(cellCountInt) == cellCount ? GetCellTable(cellCountInt, seed) : nullptr;
+	if (cellTable)
+	{
+		// Same as below but the wrapped neighbor cells are looked up in the precomputed lattice table
+		const glm::vec3 pFloor = glm::floor(pCell);
+		int wrapped[3][3];
+		for (int a = 0; a < 3; a++)
+		{
+			for (int o = 0; o < 3; o++)
+			{
+				int c = (int(pFloor[a]) + o - 1) % cellCountInt;
+				wrapped[a][o] = c < 0 ? c + cellCountInt : c;
+			}
+		}
+		for (int xo = -1; xo <= 1; xo++)
+		{
+			for (int yo = -1; yo <= 1; yo++)
+			{
+				for (int zo = -1; zo <= 1; zo++)
+				{
+					glm::vec3 tp = pFloor + glm::vec3(xo, yo, zo);
+					const int cell = (wrapped[2][zo + 1] * cellCountInt + wrapped[1][yo + 1]) * cellCountInt + wrapped[0][xo + 1];
+
+					tp = pCell - tp - cellTable[cell];
+
+					d = glm::min(d, dot(tp, tp));
+				}
+			}
+		}
+	}
+	else
 	{
-		for (int yo = -1; yo <= 1; yo++)
+		for (int xo = -1; xo <= 1; xo++)
 		{
-			for (int zo = -1; zo <= 1; zo++)
+			for (int yo = -1; yo <= 1; yo++)
 			{
-				glm::vec3 tp = glm::floor(pCell) + glm::vec3(xo, yo, zo);
+				for (int zo = -1; zo <= 1; zo++)
+				{
+					glm::vec3 tp = glm::floor(pCell) + glm::vec3(xo, yo, zo);
 
-				tp = pCell - tp - noise(glm::mod(tp, cellCount / 1));
+					tp = pCell - tp - noise(glm::mod(tp, cellCount / 1), seed);
 
-				d = glm::min(d, dot(tp, tp));
+					d = glm::min(d, dot(tp, tp));
+				}
 			}
 		}
 	}
@@ -56,14 +231,14 @@ float Tileable3dNoise::Cells(const glm::vec3& p, float cellCount)
 }
 
 
-float Tileable3dNoise::WorleyNoise(const glm::vec3& p, float cellCount)
+float Tileable3dNoise::WorleyNoise(const glm::vec3& p, float cellCount, int seed)
 {
-	return Cells(p, cellCount);
+	return Cells(p, cellCount, seed);
 }
 
 
 
-float Tileable3dNoise::PerlinNoise(const glm::vec3& pIn, float frequency, int octaveCount)
+float Tileable3dNoise::PerlinNoise(const glm::vec3& pIn, float frequency, int octaveCount, int seed)
 {
 	const float octaveFrenquencyFactor = 2;			// noise frequency factor between octave, forced to 2
 
@@ -78,8 +253,10 @@ float Tileable3dNoise::PerlinNoise(const glm::vec3& pIn, float frequency, int oc
 		//glm::vec3 p(x * freq, y * freq, z * freq);
 		//float val = glm::perlin(p, glm::vec3(freq)) *0.5 + 0.5;
 
+		// The seed picks an integer w, only its lattice corner contributes. 289 is the period of glm's permutation.
 		glm::vec4 p = glm::vec4(pIn.x, pIn.y, pIn.z, 0.0f) * glm::vec4(frequency);
-		float val = glm::perlin(p, glm::vec4(frequency));
+		p.w = float(seed % 289);
+		float val = glm::perlin(p, glm::vec4(frequency, frequency, frequency, 289.0f));
 
 		sum += val * weight;
 		weightSum += weight;
@@ -2,7 +2,10 @@
 #ifndef D_TILEABLE3DNOISE
 #define D_TILEABLE3DNOISE
 
-#include "glm\gtc\noise.hpp"
+#include "glm/gtc/noise.hpp"
+
+#include <memory>
+#include <vector>
 
 class Tileable3dNoise
 {
@@ -11,11 +14,101 @@ public:
 	/// @return Tileable Worley noise value in [0, 1].
 	/// @param p 3d coordinate in [0, 1], being the range of the repeatable pattern.
 	/// @param cellCount the number of cell for the repetitive pattern.
-	static float WorleyNoise(const glm::vec3& p, float cellCount);
+	/// @param seed selects an independent set of feature points, 0 being the original pattern.
+	static float WorleyNoise(const glm::vec3& p, float cellCount, int seed = 0);
+
+	/// Batched version of WorleyNoise evaluating 4, 8 or 16 points per instruction depending on the selected Backend.
+	/// Results are identical to WorleyNoise.
+	/// @param x, y, z arrays of count 3d coordinates in [0, 1] (structure of arrays).
+	/// @param out array receiving the count noise values in [0, 1].
+	/// @param cellCount the number of cell for the repetitive pattern.
+	static void WorleyNoiseBatch(const float* x, const float* y, const float* z, float* out, int count, float cellCount, int seed = 0);
+
+	/// WorleyNoiseBatch for several seeds at once: the cell and neighbor setup of each point is shared by all seeds.
+	/// Falls back to one WorleyNoiseBatch per seed if cellCount is not an integer.
+	/// @param seeds array of seedCount seeds.
+	/// @param out array of seedCount * count noise values, the values of seeds[k] starting at out + k * count.
+	static void WorleyNoiseBatchSeeds(const float* x, const float* y, const float* z, float* out, int count, float cellCount, const int* seeds, int seedCount);
+
+	/// Evaluates WorleyNoise for the voxels [begin, end) of a gridSize^3 grid, voxel (s, t, r) being at vec3(s, t, r) / gridSize.
+	/// Voxels are swept cell by cell so that the neighbor feature points are only loaded once per cell, which is much
+	/// faster than per voxel evaluation for low cell counts. Results are identical to WorleyNoise.
+	/// There is no distance transform path: feature points are not on the voxel lattice, so a separable transform of
+	/// points snapped to voxels is off by up to a cell at the high cell counts where it would be faster than this sweep.
+	/// @param out array of (end - begin) voxels, x being the fastest varying index.
+	static void WorleyNoiseGrid(int gridSize, const glm::ivec3& begin, const glm::ivec3& end, float cellCount, float* out, int seed = 0);
+
+	/// Instruction sets the batched functions can run with.
+	enum class Backend
+	{
+		Scalar,
+		SSE41,
+		AVX2,
+		AVX512,
+	};
+
+	/// @return the best backend supported by the CPU running the program.
+	static Backend GetBestSupportedBackend();
+
+	/// @return the backend used by the batched functions.
+	/// Defaults to GetBestSupportedBackend() unless the TILEABLE_NOISE_BACKEND environment variable names another one.
+	static Backend GetBackend();
+
+	/// Forces the backend used by the batched functions, clamped to what the CPU supports.
+	/// @return the backend actually selected.
+	static Backend SetBackend(Backend backend);
+
+	/// @return "scalar", "sse41", "avx2" or "avx512".
+	static const char* GetBackendName(Backend backend);
+
+	/// @return false if name is not one of the names returned by GetBackendName.
+	static bool ParseBackendName(const char* name, Backend& backend);
+
+	/// Hash functions placing the Worley feature points.
+	enum class Hash
+	{
+		Sin,		///< fract(sin(n) * 43758.5453), the original one. Depends on the compiler, libm and floating point flags.
+		Integer,	///< Integer lattice hash, bit reproducible on every platform and faster to evaluate.
+	};
+
+	/// @return the hash used by the Worley noise functions, Hash::Sin by default.
+	static Hash GetHash();
 
+	/// Selects the hash used by the Worley noise functions. Feature point tables of each hash are cached separately.
+	static void SetHash(Hash hash);
+
+	/// @return Tileable Perlin noise value in [0, 1].
+	/// @param p 3d coordinate in [0, 1], being the range of the repeatable pattern.
+	/// @param seed selects the w coordinate of the 4d noise, 0 being the original pattern. Repeats every 289 seeds.
+	static float PerlinNoise(const glm::vec3& p, float frequency, int octaveCount, int seed = 0);
+
+	/// Same as PerlinNoise using a native periodic 3d gradient noise (8 lattice corners) instead of the 4d glm::perlin
+	/// workaround (16 corners). The pattern differs from PerlinNoise. frequency must be an integer for the noise to tile.
 	/// @return Tileable Perlin noise value in [0, 1].
 	/// @param p 3d coordinate in [0, 1], being the range of the repeatable pattern.
-	static float PerlinNoise(const glm::vec3& p, float frequency, int octaveCount);
+	/// @param seed selects the permutation of the lattice gradients.
+	static float PerlinNoise3d(const glm::vec3& p, float frequency, int octaveCount, int seed = 0);
+
+	/// Batched version of PerlinNoise3d evaluating 4, 8 or 16 points per instruction depending on the selected Backend.
+	/// Results are identical to PerlinNoise3d.
+	static void PerlinNoise3dBatch(const float* x, const float* y, const float* z, float* out, int count, float frequency, int octaveCount, int seed = 0);
+
+	/// @return the IEEE half precision bits of value rounded to nearest even, as the F16C instructions do (NaNs are
+	/// made quiet, keeping the top of their payload).
+	static unsigned short FloatToHalf(float value);
+
+	/// @return the float value of IEEE half precision bits, which is exact.
+	static float HalfToFloat(unsigned short half);
+
+	/// Batched version of FloatToHalf, using F16C with the AVX2 and AVX512 backends. Results are identical to FloatToHalf.
+	static void FloatToHalfBatch(const float* in, unsigned short* out, int count);
+
+	/// Converts channelCount planes of count values in [0, 1] to interleaved 8 bit texels: value * 255 + bias[i] is
+	/// clamped to [0, 255] then truncated, or rounded to nearest even if round is set. Uses the selected Backend for 1
+	/// and 4 channels, results being identical to the scalar code.
+	/// @param bias array of count values added before truncating or rounding, e.g. for dithering, may be nullptr.
+	/// @param out array of count * channelCount bytes.
+	static void QuantizeUnorm8Batch(const float* const* planes, int channelCount, int count, const float* bias, bool round, unsigned char* out);
 
 private:
 
@@ -24,8 +117,24 @@ private:
 	///
 
 	static float hash(float n);
-	static float noise(const glm::vec3& x);
-	static float Cells(const glm::vec3& p, float numCells);
+	static float integerHash(int x, int y, int z, int seed);
+	static float noise(const glm::vec3& x, int seed);
+	static float Cells(const glm::vec3& p, float numCells, int seed);
+
+	typedef std::shared_ptr<const std::vector<float>> CellTableHold;
+
+	/// Feature point offsets of every cell of the lattice for an integer cellCount (cellCount^3 entries, x fastest).
+	/// Tables are built once on first use and shared by all threads. Tables of seed 0 are kept for the whole run, the
+	/// ones of other seeds are evicted least recently used first and only stay valid until the calling thread asks for
+	/// another seeded table, or while hold is kept.
+	/// @param hold receives a reference keeping a seeded table alive, may be nullptr.
+	/// @return nullptr if cellCount is above MaxCellTableCount, the caller then has to use noise() directly.
+	static const float* GetCellTable(int cellCount, int seed, CellTableHold* hold = nullptr);
+
+	static const int MaxCellTableCount = 128;
+	static const size_t MaxSeededCellTableBytes = 64 << 20;
+	static const size_t MaxSeededCellTableCount = 256;
+	static const int HashCount = 2;
 
 };
 
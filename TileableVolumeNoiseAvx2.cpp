@@ -0,0 +1,68 @@
+// AVX2 kernels, selected at runtime by Tileable3dNoise when the CPU supports them.
+// Built without global instruction set flags: MSVC gets /arch:AVX2 on this file only, GCC and Clang use a target pragma.
+// F16C comes with every AVX2 CPU and is checked along with it.
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+// No FMA contraction so that results stay identical to the scalar code
+#if defined(_MSC_VER)
+#pragma fp_contract(off)
+#endif
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2,f16c"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#pragma GCC target("avx2,f16c")
+#endif
+
+#define TILEABLENOISE_SIMD_AVX2
+#include "TileableVolumeNoiseSimd.h"
+
+namespace TileableNoiseSimd
+{
+
+	static int WorleyNoiseBatchAvx2(const float* x, const float* y, const float* z, float* out, int count, const float* cellTable, float cellCount)
+	{
+		return WorleyNoiseBatch<Lanes8>(x, y, z, out, count, cellTable, cellCount);
+	}
+
+	static int WorleyNoiseBatchSeedsAvx2(const float* x, const float* y, const float* z, float* out, int count, const float* const* cellTables, int seedCount, float cellCount)
+	{
+		return WorleyNoiseBatchSeeds<Lanes8>(x, y, z, out, count, cellTables, seedCount, cellCount);
+	}
+
+	static void WorleyCellSweepAvx2(const float* termsX, int lx, const float* termsY, int ly, const float* termsZ, int lz,
+		const int* neighbors, int neighborCount, float* out, int rowPitch, int slicePitch)
+	{
+		WorleyCellSweep<Lanes8>(termsX, lx, termsY, ly, termsZ, lz, neighbors, neighborCount, out, rowPitch, slicePitch);
+	}
+
+	static int PerlinNoiseBatchAvx2(const float* x, const float* y, const float* z, float* out, int count, float frequency, int octaveCount, const PerlinTables& tables)
+	{
+		return PerlinNoiseBatch<Lanes8>(x, y, z, out, count, frequency, octaveCount, tables);
+	}
+
+	static int FloatToHalfBatchAvx2(const float* in, unsigned short* out, int count)
+	{
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm_storeu_si128((__m128i*)(out + i), _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+		return i;
+	}
+
+	static int QuantizeUnorm8BatchAvx2(const float* const* planes, int channelCount, int count, const float* bias, bool round, unsigned char* out)
+	{
+		return QuantizeUnorm8Batch<Lanes8>(planes, channelCount, count, bias, round, out);
+	}
+
+	const Kernels KernelsAvx2 = { WorleyNoiseBatchAvx2, WorleyCellSweepAvx2, WorleyNoiseBatchSeedsAvx2, PerlinNoiseBatchAvx2, FloatToHalfBatchAvx2, QuantizeUnorm8BatchAvx2 };
+
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+// AVX-512 kernels, selected at runtime by Tileable3dNoise when the CPU supports them.
+// Built without global instruction set flags: MSVC gets /arch:AVX512 on this file only, GCC and Clang use a target pragma.
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+// No FMA contraction so that results stay identical to the scalar code
+#if defined(_MSC_VER)
+#pragma fp_contract(off)
+#endif
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#pragma GCC target("avx512f")
+#endif
+
+#define TILEABLENOISE_SIMD_AVX512
+#include "TileableVolumeNoiseSimd.h"
+
+namespace TileableNoiseSimd
+{
+
+	static int WorleyNoiseBatchAvx512(const float* x, const float* y, const float* z, float* out, int count, const float* cellTable, float cellCount)
+	{
+		return WorleyNoiseBatch<Lanes16>(x, y, z, out, count, cellTable, cellCount);
+	}
+
+	static int WorleyNoiseBatchSeedsAvx512(const float* x, const float* y, const float* z, float* out, int count, const float* const* cellTables, int seedCount, float cellCount)
+	{
+		return WorleyNoiseBatchSeeds<Lanes16>(x, y, z, out, count, cellTables, seedCount, cellCount);
+	}
+
+	static void WorleyCellSweepAvx512(const float* termsX, int lx, const float* termsY, int ly, const float* termsZ, int lz,
+		const int* neighbors, int neighborCount, float* out, int rowPitch, int slicePitch)
+	{
+		WorleyCellSweep<Lanes16>(termsX, lx, termsY, ly, termsZ, lz, neighbors, neighborCount, out, rowPitch, slicePitch);
+	}
+
+	static int PerlinNoiseBatchAvx512(const float* x, const float* y, const float* z, float* out, int count, float frequency, int octaveCount, const PerlinTables& tables)
+	{
+		return PerlinNoiseBatch<Lanes16>(x, y, z, out, count, frequency, octaveCount, tables);
+	}
+
+	static int FloatToHalfBatchAvx512(const float* in, unsigned short* out, int count)
+	{
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+			_mm256_storeu_si256((__m256i*)(out + i), _mm512_cvtps_ph(_mm512_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+		return i;
+	}
+
+	static int QuantizeUnorm8BatchAvx512(const float* const* planes, int channelCount, int count, const float* bias, bool round, unsigned char* out)
+	{
+		return QuantizeUnorm8Batch<Lanes16>(planes, channelCount, count, bias, round, out);
+	}
+
+	const Kernels KernelsAvx512 = { WorleyNoiseBatchAvx512, WorleyCellSweepAvx512, WorleyNoiseBatchSeedsAvx512, PerlinNoiseBatchAvx512, FloatToHalfBatchAvx512, QuantizeUnorm8BatchAvx512 };
+
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#endif
@@ -0,0 +1,294 @@
+
+#include "TileableVolumeNoise.h"
+#include "TileableVolumeNoiseSimd.h"
+
+#include <atomic>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#if TILEABLENOISE_SIMD_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// Runtime selection of the instruction set used by the batched noise functions.
+// Each instruction set has its own translation unit, see TileableVolumeNoiseSse41/Avx2/Avx512.cpp
+
+namespace
+{
+
+#if TILEABLENOISE_SIMD_X86
+	void cpuid(int leaf, int subLeaf, unsigned int regs[4])
+	{
+#if defined(_MSC_VER)
+		__cpuidex((int*)regs, leaf, subLeaf);
+#else
+		__cpuid_count(leaf, subLeaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	// Register state the OS saves on context switches
+	unsigned long long xgetbv0()
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		unsigned int eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return ((unsigned long long)edx << 32) | eax;
+#endif
+	}
+#endif
+
+	Tileable3dNoise::Backend DetectBestBackend()
+	{
+#if TILEABLENOISE_SIMD_X86
+		unsigned int regs[4];
+		cpuid(0, 0, regs);
+		const unsigned int maxLeaf = regs[0];
+
+		cpuid(1, 0, regs);
+		const bool sse41 = (regs[2] & (1u << 19)) != 0;
+		const bool osxsave = (regs[2] & (1u << 27)) != 0;
+		const bool avx = (regs[2] & (1u << 28)) != 0;
+		const bool f16c = (regs[2] & (1u << 29)) != 0;
+		if (!sse41)
+			return Tileable3dNoise::Backend::Scalar;
+		if (!osxsave || !avx || maxLeaf < 7)
+			return Tileable3dNoise::Backend::SSE41;
+
+		const unsigned long long xcr0 = xgetbv0();
+		cpuid(7, 0, regs);
+		const bool avx2 = (regs[1] & (1u << 5)) != 0 && f16c && (xcr0 & 0x6) == 0x6;		// XMM and YMM state
+		const bool avx512 = (regs[1] & (1u << 16)) != 0 && (xcr0 & 0xE6) == 0xE6;			// and opmask, ZMM state
+		if (avx2 && avx512)
+			return Tileable3dNoise::Backend::AVX512;
+		if (avx2)
+			return Tileable3dNoise::Backend::AVX2;
+		return Tileable3dNoise::Backend::SSE41;
+#else
+		return Tileable3dNoise::Backend::Scalar;
+#endif
+	}
+
+	Tileable3dNoise::Backend DefaultBackend()
+	{
+		Tileable3dNoise::Backend backend = Tileable3dNoise::GetBestSupportedBackend();
+		const char* forced = getenv("TILEABLE_NOISE_BACKEND");
+		Tileable3dNoise::Backend forcedBackend;
+		if (forced && Tileable3dNoise::ParseBackendName(forced, forcedBackend) && forcedBackend < backend)
+			backend = forcedBackend;
+		return backend;
+	}
+
+	std::atomic<int> gForcedBackend(-1);
+
+}
+
+Tileable3dNoise::Backend Tileable3dNoise::GetBestSupportedBackend()
+{
+	static const Backend best = DetectBestBackend();
+	return best;
+}
+
+Tileable3dNoise::Backend Tileable3dNoise::GetBackend()
+{
+	const int forced = gForcedBackend.load(std::memory_order_relaxed);
+	if (forced >= 0)
+		return Backend(forced);
+	static const Backend defaultBackend = DefaultBackend();
+	return defaultBackend;
+}
+
+Tileable3dNoise::Backend Tileable3dNoise::SetBackend(Backend backend)
+{
+	const Backend best = GetBestSupportedBackend();
+	if (backend > best)
+		backend = best;
+	gForcedBackend.store(int(backend), std::memory_order_relaxed);
+	return backend;
+}
+
+const char* Tileable3dNoise::GetBackendName(Backend backend)
+{
+	switch (backend)
+	{
+	case Backend::SSE41:	return "sse41";
+	case Backend::AVX2:		return "avx2";
+	case Backend::AVX512:	return "avx512";
+	default:				return "scalar";
+	}
+}
+
+bool Tileable3dNoise::ParseBackendName(const char* name, Backend& backend)
+{
+	const Backend backends[] = { Backend::Scalar, Backend::SSE41, Backend::AVX2, Backend::AVX512 };
+	for (Backend b : backends)
+	{
+		if (strcmp(name, GetBackendName(b)) == 0)
+		{
+			backend = b;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+
+const TileableNoiseSimd::Kernels* TileableNoiseSimd::GetKernels()
+{
+#if TILEABLENOISE_SIMD_X86
+	switch (Tileable3dNoise::GetBackend())
+	{
+	case Tileable3dNoise::Backend::SSE41:	return &TileableNoiseSimd::KernelsSse41;
+	case Tileable3dNoise::Backend::AVX2:	return &TileableNoiseSimd::KernelsAvx2;
+	case Tileable3dNoise::Backend::AVX512:	return &TileableNoiseSimd::KernelsAvx512;
+	default:								break;
+	}
+#endif
+	return nullptr;
+}
+
+void Tileable3dNoise::WorleyNoiseBatch(const float* x, const float* y, const float* z, float* out, int count, float cellCount, int seed)
+{
+	int i = 0;
+	const int cellCountInt = int(cellCount);
+	const float* cellTable = float(cellCountInt) == cellCount ? GetCellTable(cellCountInt, seed) : nullptr;
+	const TileableNoiseSimd::Kernels* kernels = TileableNoiseSimd::GetKernels();
+	if (cellTable && kernels)
+	{
+		i = kernels->worleyNoiseBatch(x, y, z, out, count, cellTable, cellCount);
+	}
+	for (; i < count; i++)
+	{
+		out[i] = Cells(glm::vec3(x[i], y[i], z[i]), cellCount, seed);
+	}
+}
+
+void Tileable3dNoise::WorleyNoiseBatchSeeds(const float* x, const float* y, const float* z, float* out, int count, float cellCount, const int* seeds, int seedCount)
+{
+	const int cellCountInt = int(cellCount);
+	const TileableNoiseSimd::Kernels* kernels = TileableNoiseSimd::GetKernels();
+	// Each table is held since getting the next one may evict it
+	std::vector<const float*> cellTables(seedCount);
+	std::vector<CellTableHold> holds(seedCount);
+	for (int k = 0; k < seedCount; k++)
+	{
+		cellTables[k] = float(cellCountInt) == cellCount ? GetCellTable(cellCountInt, seeds[k], &holds[k]) : nullptr;
+		if (!cellTables[k] || !kernels)
+		{
+			for (int s = 0; s < seedCount; s++)
+				WorleyNoiseBatch(x, y, z, out + size_t(s) * count, count, cellCount, seeds[s]);
+			return;
+		}
+	}
+
+	const int done = kernels->worleyNoiseBatchSeeds(x, y, z, out, count, cellTables.data(), seedCount, cellCount);
+	for (int k = 0; k < seedCount; k++)
+	{
+		for (int i = done; i < count; i++)
+			out[size_t(k) * count + i] = Cells(glm::vec3(x[i], y[i], z[i]), cellCount, seeds[k]);
+	}
+}
+
+unsigned short Tileable3dNoise::FloatToHalf(float value)
+{
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+	const unsigned int sign = (bits >> 16) & 0x8000u;
+	const unsigned int abs = bits & 0x7FFFFFFFu;
+
+	if (abs > 0x7F800000u)
+		return (unsigned short)(sign | 0x7E00u | ((abs >> 13) & 0x3FFu));		// NaN
+	if (abs >= 0x47800000u)
+		return (unsigned short)(sign | 0x7C00u);								// 65536 and above, infinity
+	if (abs < 0x33000000u)
+		return (unsigned short)sign;											// up to 2^-25 (a tie with 0)
+
+	// Shift the mantissa to the half one, rebiasing the exponent of normals, then round to nearest even. A carry out of
+	// the mantissa correctly increments the exponent, up to infinity.
+	unsigned int half, rest, shift;
+	if (abs < 0x38800000u)
+	{
+		// Denormal half, in units of 2^-24
+		const unsigned int mantissa = (abs & 0x7FFFFFu) | 0x800000u;
+		shift = 126u - (abs >> 23);
+		half = mantissa >> shift;
+		rest = mantissa & ((1u << shift) - 1u);
+	}
+	else
+	{
+		shift = 13u;
+		half = (abs >> 13) - (112u << 10);
+		rest = abs & 0x1FFFu;
+	}
+	const unsigned int tie = 1u << (shift - 1u);
+	if (rest > tie || (rest == tie && (half & 1u)))
+		half++;
+	return (unsigned short)(sign | half);
+}
+
+float Tileable3dNoise::HalfToFloat(unsigned short half)
+{
+	const unsigned int sign = (unsigned int)(half & 0x8000u) << 16;
+	const unsigned int exponent = (half >> 10) & 0x1Fu;
+	const unsigned int mantissa = half & 0x3FFu;
+	unsigned int bits;
+	if (exponent == 0x1Fu)
+		bits = sign | 0x7F800000u | (mantissa << 13);							// infinity and NaN
+	else if (exponent != 0)
+		bits = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+	else
+	{
+		// Zero and denormals, mantissa * 2^-24
+		const float value = float(mantissa) * (1.0f / 16777216.0f);
+		memcpy(&bits, &value, sizeof(bits));
+		bits |= sign;
+	}
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+void Tileable3dNoise::FloatToHalfBatch(const float* in, unsigned short* out, int count)
+{
+	int i = 0;
+	const TileableNoiseSimd::Kernels* kernels = TileableNoiseSimd::GetKernels();
+	if (kernels)
+	{
+		i = kernels->floatToHalfBatch(in, out, count);
+	}
+	for (; i < count; i++)
+	{
+		out[i] = FloatToHalf(in[i]);
+	}
+}
+
+void Tileable3dNoise::QuantizeUnorm8Batch(const float* const* planes, int channelCount, int count, const float* bias, bool round, unsigned char* out)
+{
+	int i = 0;
+	const TileableNoiseSimd::Kernels* kernels = TileableNoiseSimd::GetKernels();
+	if (kernels)
+	{
+		i = kernels->quantizeUnorm8Batch(planes, channelCount, count, bias, round, out);
+	}
+	for (; i < count; i++)
+	{
+		for (int c = 0; c < channelCount; c++)
+		{
+			// Same operations and NaN handling as the min and max instructions of the kernels
+			float x = planes[c][i] * 255.0f;
+			if (bias)
+				x = x + bias[i];
+			x = fminf(x, 255.0f);
+			x = fmaxf(x, 0.0f);
+			out[size_t(i) * channelCount + c] = (unsigned char)(round ? nearbyintf(x) : x);
+		}
+	}
+}
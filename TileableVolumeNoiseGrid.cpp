@@ -0,0 +1,181 @@
+
+#include "TileableVolumeNoise.h"
+#include "TileableVolumeNoiseSimd.h"
+
+#include <vector>
+
+// Worley noise evaluated on a regular grid cell by cell: the 27 neighbor feature points of a cell are loaded once and
+// all voxels inside the cell are swept using per axis distance terms.
+
+namespace
+{
+
+	// Voxels along one axis of the grid, grouped in runs falling in the same Worley cell
+	struct GridAxis
+	{
+		std::vector<float> pCell;		// voxel coordinate in cell units
+		std::vector<float> pFloor;		// cell of the voxel
+		std::vector<int> runBegin;		// first voxel of each run, followed by the end of the last run
+		std::vector<int> runWrapped;	// wrapped cell index of the -1, 0 and +1 neighbors of each run
+
+		void Build(int begin, int end, float normFact, float cellCount, int cellCountInt)
+		{
+			const int count = end - begin;
+			pCell.resize(count);
+			pFloor.resize(count);
+			runBegin.clear();
+			runWrapped.clear();
+			for (int i = 0; i < count; i++)
+			{
+				// Same arithmetic as WorleyNoise(vec3(s, t, r) * normFact, cellCount)
+				const float coord = float(begin + i) * normFact;
+				pCell[i] = coord * cellCount;
+				pFloor[i] = glm::floor(pCell[i]);
+				if (i == 0 || pFloor[i] != pFloor[i - 1])
+				{
+					runBegin.push_back(i);
+					for (int o = -1; o <= 1; o++)
+					{
+						int c = (int(pFloor[i]) + o) % cellCountInt;
+						runWrapped.push_back(c < 0 ? c + cellCountInt : c);
+					}
+				}
+			}
+			runBegin.push_back(count);
+		}
+
+		int GetRunCount() const { return int(runBegin.size()) - 1; }
+
+		// Squared distance term along this axis of every voxel of a run to the 27 neighbor feature points, [neighbor][voxel]
+		void ComputeTerms(int run, int axis, const float* h, std::vector<float>& terms) const
+		{
+			const int first = runBegin[run];
+			const int length = runBegin[run + 1] - first;
+			terms.resize(27 * length);
+			for (int n = 0; n < 27; n++)
+			{
+				const int o = axis == 0 ? n / 9 : axis == 1 ? (n / 3) % 3 : n % 3;
+				for (int i = 0; i < length; i++)
+				{
+					const float tp = pCell[first + i] - (pFloor[first + i] + float(o - 1));
+					const float d = tp - h[n];
+					terms[n * length + i] = d * d;
+				}
+			}
+		}
+	};
+
+	// Lowest and highest term of each of the 27 neighbors over a run
+	void GetTermBounds(const std::vector<float>& terms, int length, float* lower, float* upper)
+	{
+		for (int n = 0; n < 27; n++)
+		{
+			const float* t = &terms[n * length];
+			float lo = t[0], hi = t[0];
+			for (int i = 1; i < length; i++)
+			{
+				lo = glm::min(lo, t[i]);
+				hi = glm::max(hi, t[i]);
+			}
+			lower[n] = lo;
+			upper[n] = hi;
+		}
+	}
+
+}
+
+void Tileable3dNoise::WorleyNoiseGrid(int gridSize, const glm::ivec3& begin, const glm::ivec3& end, float cellCount, float* out, int seed)
+{
+	const glm::ivec3 size = end - begin;
+	const float normFact = 1.0f / float(gridSize);
+
+	const int cellCountInt = int(cellCount);
+	const float* cellTable = float(cellCountInt) == cellCount ? GetCellTable(cellCountInt, seed) : nullptr;
+	if (!cellTable || float(gridSize) < 16.0f * cellCount)
+	{
+		// Per cell setup does not pay off below 16 voxels per cell (and too short rows for the SIMD sweep).
+		// Also used without a lattice table: evaluate each voxel, one row at a time.
+		std::vector<float> x(size.x), y(size.x), z(size.x);
+		for (int r = begin.z; r < end.z; r++)
+		{
+			for (int t = begin.y; t < end.y; t++)
+			{
+				for (int s = begin.x; s < end.x; s++)
+				{
+					const glm::vec3 coord = glm::vec3(s, t, r) * glm::vec3(normFact);
+					x[s - begin.x] = coord.x;
+					y[s - begin.x] = coord.y;
+					z[s - begin.x] = coord.z;
+				}
+				WorleyNoiseBatch(x.data(), y.data(), z.data(), out + ((r - begin.z) * size.y + (t - begin.y)) * size.x, size.x, cellCount, seed);
+			}
+		}
+		return;
+	}
+
+	GridAxis axes[3];
+	for (int a = 0; a < 3; a++)
+		axes[a].Build(begin[a], end[a], normFact, cellCount, cellCountInt);
+
+	const TileableNoiseSimd::Kernels* kernels = TileableNoiseSimd::GetKernels();
+	const int rowPitch = size.x;
+	const int slicePitch = size.x * size.y;
+
+	float h[27];
+	float lower[3][27], upper[3][27];
+	int neighbors[27];
+	std::vector<float> termsX, termsY, termsZ;
+	for (int rz = 0; rz < axes[2].GetRunCount(); rz++)
+	{
+		for (int ry = 0; ry < axes[1].GetRunCount(); ry++)
+		{
+			for (int rx = 0; rx < axes[0].GetRunCount(); rx++)
+			{
+				// Feature points of the 27 neighbor cells, n = (xo * 3 + yo) * 3 + zo as in Cells
+				for (int n = 0; n < 27; n++)
+				{
+					const int wx = axes[0].runWrapped[rx * 3 + n / 9];
+					const int wy = axes[1].runWrapped[ry * 3 + (n / 3) % 3];
+					const int wz = axes[2].runWrapped[rz * 3 + n % 3];
+					h[n] = cellTable[(wz * cellCountInt + wy) * cellCountInt + wx];
+				}
+
+				const int x0 = axes[0].runBegin[rx], lx = axes[0].runBegin[rx + 1] - x0;
+				const int y0 = axes[1].runBegin[ry], ly = axes[1].runBegin[ry + 1] - y0;
+				const int z0 = axes[2].runBegin[rz], lz = axes[2].runBegin[rz + 1] - z0;
+				axes[0].ComputeTerms(rx, 0, h, termsX);
+				axes[1].ComputeTerms(ry, 1, h, termsY);
+				axes[2].ComputeTerms(rz, 2, h, termsZ);
+				GetTermBounds(termsX, lx, lower[0], upper[0]);
+				GetTermBounds(termsY, ly, lower[1], upper[1]);
+				GetTermBounds(termsZ, lz, lower[2], upper[2]);
+
+				// Float addition is monotonic so the bounds hold exactly: a neighbor whose lowest distance is above the
+				// highest distance of another one, or at least 1 where the result is clamped, never changes the result.
+				float closest = 1.0e10f;
+				for (int n = 0; n < 27; n++)
+					closest = glm::min(closest, (upper[0][n] + upper[1][n]) + upper[2][n]);
+				int neighborCount = 0;
+				for (int n = 0; n < 27; n++)
+				{
+					const float lowest = (lower[0][n] + lower[1][n]) + lower[2][n];
+					if (lowest <= closest && lowest < 1.0f)
+						neighbors[neighborCount++] = n;
+				}
+
+				float* dst = out + (z0 * size.y + y0) * size.x + x0;
+				if (kernels)
+				{
+					kernels->worleyCellSweep(termsX.data(), lx, termsY.data(), ly, termsZ.data(), lz, neighbors, neighborCount, dst, rowPitch, slicePitch);
+				}
+				else
+				{
+					for (int k = 0; k < lz; k++)
+						for (int j = 0; j < ly; j++)
+							TileableNoiseSimd::WorleyCellSweepRow(termsX.data(), lx, termsY.data(), ly, termsZ.data(), lz, j, k, neighbors, neighborCount,
+								dst + k * slicePitch + j * rowPitch, 0, lx);
+				}
+			}
+		}
+	}
+}
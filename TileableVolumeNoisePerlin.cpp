@@ -0,0 +1,170 @@
+
+#include "TileableVolumeNoise.h"
+#include "TileableVolumeNoiseSimd.h"
+
+#include <math.h>
+#include <map>
+#include <memory>
+#include <mutex>
+
+// Periodic 3d gradient noise (Ken Perlin's improved noise), evaluated with 8 lattice corners instead of the 16 of the
+// 4d glm::perlin used by PerlinNoise. The batched version in TileableVolumeNoiseSimd.h does the same operations in
+// the same order, so both give identical results.
+
+namespace
+{
+
+	float Fade(float t)
+	{
+		return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+	}
+
+	float Lerp(float a, float b, float t)
+	{
+		return a + t * (b - a);
+	}
+
+	// Lattice coordinate of the cell and of the next one, wrapped by period then by the permutation table size
+	void WrapLattice(float pFloor, float period, float& i0, float& i1)
+	{
+		const float w0 = pFloor - period * floorf(pFloor / period);
+		const float w1Unwrapped = w0 + 1.0f;
+		const float w1 = w1Unwrapped >= period ? 0.0f : w1Unwrapped;
+		i0 = w0 - 256.0f * floorf(w0 * (1.0f / 256.0f));
+		i1 = w1 - 256.0f * floorf(w1 * (1.0f / 256.0f));
+	}
+
+	float PerlinOctave(const TileableNoiseSimd::PerlinTables& tables, const glm::vec3& p, float period)
+	{
+		float i0[3], i1[3], f[3], u[3];
+		for (int a = 0; a < 3; a++)
+		{
+			const float pFloor = floorf(p[a]);
+			WrapLattice(pFloor, period, i0[a], i1[a]);
+			f[a] = p[a] - pFloor;
+			u[a] = Fade(f[a]);
+		}
+
+		float corner[8];
+		for (int c = 0; c < 8; c++)
+		{
+			const int cx = c & 1, cy = (c >> 1) & 1, cz = c >> 2;
+			const float hx = tables.perm[int(cx ? i1[0] : i0[0])];
+			const float hy = tables.perm[int(hx + (cy ? i1[1] : i0[1]))];
+			const int h = int(hy + (cz ? i1[2] : i0[2]));
+			const float dx = f[0] - float(cx);
+			const float dy = f[1] - float(cy);
+			const float dz = f[2] - float(cz);
+			corner[c] = (tables.gradX[h] * dx + tables.gradY[h] * dy) + tables.gradZ[h] * dz;
+		}
+
+		const float x00 = Lerp(corner[0], corner[1], u[0]);
+		const float x10 = Lerp(corner[2], corner[3], u[0]);
+		const float x01 = Lerp(corner[4], corner[5], u[0]);
+		const float x11 = Lerp(corner[6], corner[7], u[0]);
+		return Lerp(Lerp(x00, x10, u[1]), Lerp(x01, x11, u[1]), u[2]);
+	}
+
+	void BuildPerlinTables(int seed, TileableNoiseSimd::PerlinTables& tables)
+	{
+		// Integer shuffle so that the tables are the same on every platform
+		int perm[256];
+		for (int i = 0; i < 256; i++)
+			perm[i] = i;
+		unsigned int state = 0x9E3779B9u ^ (unsigned(seed) * 0x85EBCA6Bu);
+		for (int i = 255; i > 0; i--)
+		{
+			state = state * 1664525u + 1013904223u;
+			const int j = int((state >> 8) % unsigned(i + 1));
+			const int swap = perm[i];
+			perm[i] = perm[j];
+			perm[j] = swap;
+		}
+
+		// The 12 edge directions of a cube, padded to 16 (Perlin, Improving Noise)
+		static const float gradients[16][3] =
+		{
+			{ 1, 1, 0 }, { -1, 1, 0 }, { 1, -1, 0 }, { -1, -1, 0 },
+			{ 1, 0, 1 }, { -1, 0, 1 }, { 1, 0, -1 }, { -1, 0, -1 },
+			{ 0, 1, 1 }, { 0, -1, 1 }, { 0, 1, -1 }, { 0, -1, -1 },
+			{ 1, 1, 0 }, { 0, -1, 1 }, { -1, 1, 0 }, { 0, -1, -1 },
+		};
+		for (int i = 0; i < 512; i++)
+		{
+			const int h = perm[i & 255];
+			tables.perm[i] = float(h);
+			tables.gradX[i] = gradients[h & 15][0];
+			tables.gradY[i] = gradients[h & 15][1];
+			tables.gradZ[i] = gradients[h & 15][2];
+		}
+	}
+
+}
+
+const TileableNoiseSimd::PerlinTables& TileableNoiseSimd::GetPerlinTables(int seed)
+{
+	// Same caching as Tileable3dNoise::GetCellTable: seed 0 is built once, other seeds are kept in a map
+	struct DefaultTables
+	{
+		PerlinTables tables;
+		DefaultTables() { BuildPerlinTables(0, tables); }
+	};
+	static const DefaultTables defaultTables;
+	if (seed == 0)
+		return defaultTables.tables;
+
+	static std::map<int, std::unique_ptr<PerlinTables>> seededTables;
+	static std::mutex seededTablesMutex;
+	static thread_local int lastSeed = 0;
+	static thread_local const PerlinTables* lastTables = nullptr;
+	if (lastTables && lastSeed == seed)
+		return *lastTables;
+
+	std::lock_guard<std::mutex> lock(seededTablesMutex);
+	std::unique_ptr<PerlinTables>& tables = seededTables[seed];
+	if (!tables)
+	{
+		tables.reset(new PerlinTables);
+		BuildPerlinTables(seed, *tables);
+	}
+	lastSeed = seed;
+	lastTables = tables.get();
+	return *tables;
+}
+
+float Tileable3dNoise::PerlinNoise3d(const glm::vec3& p, float frequency, int octaveCount, int seed)
+{
+	const TileableNoiseSimd::PerlinTables& tables = TileableNoiseSimd::GetPerlinTables(seed);
+
+	// Same octave weighting as PerlinNoise
+	float sum = 0.0f;
+	float weightSum = 0.0f;
+	float weight = 0.5f;
+	for (int oct = 0; oct < octaveCount; oct++)
+	{
+		sum += PerlinOctave(tables, p * frequency, frequency) * weight;
+		weightSum += weight;
+
+		weight *= weight;
+		frequency *= 2.0f;
+	}
+
+	float noise = (sum / weightSum) * 0.5f + 0.5f;
+	noise = std::fminf(noise, 1.0f);
+	noise = std::fmaxf(noise, 0.0f);
+	return noise;
+}
+
+void Tileable3dNoise::PerlinNoise3dBatch(const float* x, const float* y, const float* z, float* out, int count, float frequency, int octaveCount, int seed)
+{
+	int i = 0;
+	const TileableNoiseSimd::Kernels* kernels = TileableNoiseSimd::GetKernels();
+	if (kernels)
+	{
+		i = kernels->perlinNoiseBatch(x, y, z, out, count, frequency, octaveCount, TileableNoiseSimd::GetPerlinTables(seed));
+	}
+	for (; i < count; i++)
+	{
+		out[i] = PerlinNoise3d(glm::vec3(x[i], y[i], z[i]), frequency, octaveCount, seed);
+	}
+}
@@ -0,0 +1,485 @@
+#ifndef D_TILEABLE3DNOISE_SIMD
+#define D_TILEABLE3DNOISE_SIMD
+
+// Internal header: SIMD lane wrappers and the batched noise kernels written on top of them.
+// Lane wrappers are only defined in the translation units compiled for (or targeting) the matching instruction set,
+// which define TILEABLENOISE_SIMD_SSE41, TILEABLENOISE_SIMD_AVX2 or TILEABLENOISE_SIMD_AVX512 before including this file.
+
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TILEABLENOISE_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace TileableNoiseSimd
+{
+
+	/// Permutation and gradient tables of the 3d gradient noise, 512 entries so that perm[perm[x] + y] + z needs no wrapping.
+	/// Values are stored as floats to be gathered with float indices.
+	struct PerlinTables
+	{
+		float perm[512];
+		float gradX[512];		///< Gradient of the lattice corner hashing to perm[i].
+		float gradY[512];
+		float gradZ[512];
+	};
+
+	/// Tables of a seed, built on first use and shared by all threads.
+	const PerlinTables& GetPerlinTables(int seed);
+
+	///
+	/// Kernels compiled for one instruction set.
+	///
+	struct Kernels
+	{
+		/// Returns how many points it processed, the caller does the remainder.
+		int(*worleyNoiseBatch)(const float* x, const float* y, const float* z, float* out, int count, const float* cellTable, float cellCount);
+
+		/// Worley distance of the voxels of one cell given the per axis squared distance terms to each neighbor
+		/// feature point, stored [neighbor][voxel]. Only the listed neighbors are considered.
+		void(*worleyCellSweep)(const float* termsX, int lx, const float* termsY, int ly, const float* termsZ, int lz,
+			const int* neighbors, int neighborCount, float* out, int rowPitch, int slicePitch);
+
+		/// worleyNoiseBatch for the seedCount cell tables of different seeds, out being seedCount arrays of count values.
+		int(*worleyNoiseBatchSeeds)(const float* x, const float* y, const float* z, float* out, int count, const float* const* cellTables, int seedCount, float cellCount);
+
+		/// Same as worleyNoiseBatch for Tileable3dNoise::PerlinNoise3d.
+		int(*perlinNoiseBatch)(const float* x, const float* y, const float* z, float* out, int count, float frequency, int octaveCount, const PerlinTables& tables);
+
+		/// Same as worleyNoiseBatch for Tileable3dNoise::FloatToHalf.
+		int(*floatToHalfBatch)(const float* in, unsigned short* out, int count);
+
+		/// Same as worleyNoiseBatch for Tileable3dNoise::QuantizeUnorm8Batch.
+		int(*quantizeUnorm8Batch)(const float* const* planes, int channelCount, int count, const float* bias, bool round, unsigned char* out);
+	};
+
+	extern const Kernels KernelsSse41;
+	extern const Kernels KernelsAvx2;
+	extern const Kernels KernelsAvx512;
+
+	/// @return the kernels of the backend selected by Tileable3dNoise, nullptr for the scalar backend.
+	const Kernels* GetKernels();
+
+	/// Scalar version of Kernels::worleyCellSweep for the voxels [first, last) of a row.
+	/// Internal linkage so that each translation unit gets its own copy compiled for its instruction set, an inline definition
+	/// could be merged by the linker into the AVX-512 one and used by the scalar grid path.
+	static inline void WorleyCellSweepRow(const float* termsX, int lx, const float* termsY, int ly, const float* termsZ, int lz, int j, int k, const int* neighbors, int neighborCount, float* dst, int first, int last)
+	{
+		for (int i = first; i < last; i++)
+		{
+			float d = 1.0e10f;
+			for (int c = 0; c < neighborCount; c++)
+			{
+				const int n = neighbors[c];
+				// Summed in the same order as dot() so that results are identical to Tileable3dNoise::Cells
+				const float dist = (termsX[n * lx + i] + termsY[n * ly + j]) + termsZ[n * lz + k];
+				d = d < dist ? d : dist;
+			}
+			d = d < 1.0f ? d : 1.0f;
+			dst[i] = d > 0.0f ? d : 0.0f;
+		}
+	}
+
+#if defined(TILEABLENOISE_SIMD_SSE41)
+
+	/// 4 lanes, SSE4.1
+	struct Lanes4
+	{
+		typedef __m128 F;
+		typedef __m128 M;
+		static const int Width = 4;
+
+		static F load(const float* p) { return _mm_loadu_ps(p); }
+		static void store(float* p, F a) { _mm_storeu_ps(p, a); }
+		static F set1(float a) { return _mm_set1_ps(a); }
+		static F add(F a, F b) { return _mm_add_ps(a, b); }
+		static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+		static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+		static F div(F a, F b) { return _mm_div_ps(a, b); }
+		static F min(F a, F b) { return _mm_min_ps(a, b); }
+		static F max(F a, F b) { return _mm_max_ps(a, b); }
+		static F floor(F a) { return _mm_floor_ps(a); }
+		/// Rounds to nearest even.
+		static F round(F a) { return _mm_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+		static M cmplt(F a, F b) { return _mm_cmplt_ps(a, b); }
+		static M cmpge(F a, F b) { return _mm_cmpge_ps(a, b); }
+		/// @return a where m is set, b otherwise.
+		static F select(M m, F a, F b) { return _mm_blendv_ps(b, a, m); }
+		/// @return table[index] per lane, index being integer values stored as float.
+		static F gather(const float* table, F index)
+		{
+			int i[4];
+			_mm_storeu_si128((__m128i*)i, _mm_cvttps_epi32(index));
+			return _mm_setr_ps(table[i[0]], table[i[1]], table[i[2]], table[i[3]]);
+		}
+		/// Stores the Width integer values in [0, 255] of a as bytes.
+		static void storeBytes(unsigned char* p, F a)
+		{
+			const __m128i i = _mm_cvttps_epi32(a);
+			const int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(i, i), i));
+			memcpy(p, &bytes, 4);
+		}
+		/// Stores the Width texels of the integer values in [0, 255] of r, g, b and a as interleaved bytes.
+		static void storeRgba(unsigned char* p, F r, F g, F b, F a)
+		{
+			const __m128i rg = _mm_or_si128(_mm_cvttps_epi32(r), _mm_slli_epi32(_mm_cvttps_epi32(g), 8));
+			const __m128i ba = _mm_or_si128(_mm_slli_epi32(_mm_cvttps_epi32(b), 16), _mm_slli_epi32(_mm_cvttps_epi32(a), 24));
+			_mm_storeu_si128((__m128i*)p, _mm_or_si128(rg, ba));
+		}
+	};
+
+#endif
+
+#if defined(TILEABLENOISE_SIMD_AVX2)
+
+	/// 8 lanes, AVX2
+	struct Lanes8
+	{
+		typedef __m256 F;
+		typedef __m256 M;
+		static const int Width = 8;
+
+		static F load(const float* p) { return _mm256_loadu_ps(p); }
+		static void store(float* p, F a) { _mm256_storeu_ps(p, a); }
+		static F set1(float a) { return _mm256_set1_ps(a); }
+		static F add(F a, F b) { return _mm256_add_ps(a, b); }
+		static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+		static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+		static F div(F a, F b) { return _mm256_div_ps(a, b); }
+		static F min(F a, F b) { return _mm256_min_ps(a, b); }
+		static F max(F a, F b) { return _mm256_max_ps(a, b); }
+		static F floor(F a) { return _mm256_floor_ps(a); }
+		static F round(F a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+		static M cmplt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+		static M cmpge(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+		static F select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+		static F gather(const float* table, F index) { return _mm256_i32gather_ps(table, _mm256_cvttps_epi32(index), 4); }
+		static void storeBytes(unsigned char* p, F a)
+		{
+			const __m256i i = _mm256_cvttps_epi32(a);
+			const __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(i), _mm256_extracti128_si256(i, 1));
+			_mm_storel_epi64((__m128i*)p, _mm_packus_epi16(words, words));
+		}
+		static void storeRgba(unsigned char* p, F r, F g, F b, F a)
+		{
+			const __m256i rg = _mm256_or_si256(_mm256_cvttps_epi32(r), _mm256_slli_epi32(_mm256_cvttps_epi32(g), 8));
+			const __m256i ba = _mm256_or_si256(_mm256_slli_epi32(_mm256_cvttps_epi32(b), 16), _mm256_slli_epi32(_mm256_cvttps_epi32(a), 24));
+			_mm256_storeu_si256((__m256i*)p, _mm256_or_si256(rg, ba));
+		}
+	};
+
+#endif
+
+#if defined(TILEABLENOISE_SIMD_AVX512)
+
+	/// 16 lanes, AVX-512F
+	struct Lanes16
+	{
+		typedef __m512 F;
+		typedef __mmask16 M;
+		static const int Width = 16;
+
+		static F load(const float* p) { return _mm512_loadu_ps(p); }
+		static void store(float* p, F a) { _mm512_storeu_ps(p, a); }
+		static F set1(float a) { return _mm512_set1_ps(a); }
+		static F add(F a, F b) { return _mm512_add_ps(a, b); }
+		static F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+		static F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+		static F div(F a, F b) { return _mm512_div_ps(a, b); }
+		static F min(F a, F b) { return _mm512_min_ps(a, b); }
+		static F max(F a, F b) { return _mm512_max_ps(a, b); }
+		static F floor(F a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+		static F round(F a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+		static M cmplt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+		static M cmpge(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+		static F select(M m, F a, F b) { return _mm512_mask_blend_ps(m, b, a); }
+		static F gather(const float* table, F index) { return _mm512_i32gather_ps(_mm512_cvttps_epi32(index), table, 4); }
+		static void storeBytes(unsigned char* p, F a) { _mm_storeu_si128((__m128i*)p, _mm512_cvtepi32_epi8(_mm512_cvttps_epi32(a))); }
+		static void storeRgba(unsigned char* p, F r, F g, F b, F a)
+		{
+			const __m512i rg = _mm512_or_si512(_mm512_cvttps_epi32(r), _mm512_slli_epi32(_mm512_cvttps_epi32(g), 8));
+			const __m512i ba = _mm512_or_si512(_mm512_slli_epi32(_mm512_cvttps_epi32(b), 16), _mm512_slli_epi32(_mm512_cvttps_epi32(a), 24));
+			_mm512_storeu_si512(p, _mm512_or_si512(rg, ba));
+		}
+	};
+
+#endif
+
+#if defined(TILEABLENOISE_SIMD_SSE41) || defined(TILEABLENOISE_SIMD_AVX2) || defined(TILEABLENOISE_SIMD_AVX512)
+
+	///
+	/// Batched Worley noise, same math as Tileable3dNoise::Cells using the lattice table of an integer cellCount.
+	/// Evaluates the largest multiple of L::Width points and returns how many were processed, the caller does the remainder.
+	///
+	template<typename L>
+	int WorleyNoiseBatch(const float* x, const float* y, const float* z, float* out, int count, const float* cellTable, float cellCount)
+	{
+		typedef typename L::F F;
+
+		const F zero = L::set1(0.0f);
+		const F one = L::set1(1.0f);
+		const F c = L::set1(cellCount);
+		const F cMinusOne = L::set1(cellCount - 1.0f);
+		const F cSquared = L::set1(cellCount * cellCount);
+
+		int i = 0;
+		for (; i + L::Width <= count; i += L::Width)
+		{
+			const F pCell[3] = { L::mul(L::load(x + i), c), L::mul(L::load(y + i), c), L::mul(L::load(z + i), c) };
+
+			// Lattice cell and its wrapped neighbors along each axis, kept as floats (exact for the table sizes used)
+			F pFloor[3];
+			F wrapped[3][3];
+			for (int a = 0; a < 3; a++)
+			{
+				pFloor[a] = L::floor(pCell[a]);
+				const F w = L::sub(pFloor[a], L::mul(c, L::floor(L::div(pFloor[a], c))));	// glm::mod
+				const F wPlusOne = L::add(w, one);
+				wrapped[a][0] = L::select(L::cmplt(w, one), cMinusOne, L::sub(w, one));
+				wrapped[a][1] = w;
+				wrapped[a][2] = L::select(L::cmpge(wPlusOne, c), zero, wPlusOne);
+			}
+
+			F d = L::set1(1.0e10f);
+			for (int xo = 0; xo < 3; xo++)
+			{
+				const F tpx = L::sub(pCell[0], L::add(pFloor[0], L::set1(float(xo - 1))));
+				for (int yo = 0; yo < 3; yo++)
+				{
+					const F tpy = L::sub(pCell[1], L::add(pFloor[1], L::set1(float(yo - 1))));
+					const F cellXY = L::add(L::mul(wrapped[1][yo], c), wrapped[0][xo]);
+					for (int zo = 0; zo < 3; zo++)
+					{
+						const F tpz = L::sub(pCell[2], L::add(pFloor[2], L::set1(float(zo - 1))));
+						const F h = L::gather(cellTable, L::add(L::mul(wrapped[2][zo], cSquared), cellXY));
+
+						const F dx = L::sub(tpx, h);
+						const F dy = L::sub(tpy, h);
+						const F dz = L::sub(tpz, h);
+						const F dist = L::add(L::add(L::mul(dx, dx), L::mul(dy, dy)), L::mul(dz, dz));
+						d = L::min(d, dist);
+					}
+				}
+			}
+			d = L::max(L::min(d, one), zero);
+			L::store(out + i, d);
+		}
+		return i;
+	}
+
+	///
+	/// WorleyNoiseBatch for several cell tables: the cell, wrapped neighbors and offsets of each point are computed once
+	/// then the 27 neighbors are tested against the feature points of every table.
+	///
+	template<typename L>
+	int WorleyNoiseBatchSeeds(const float* x, const float* y, const float* z, float* out, int count, const float* const* cellTables, int seedCount, float cellCount)
+	{
+		typedef typename L::F F;
+
+		const F zero = L::set1(0.0f);
+		const F one = L::set1(1.0f);
+		const F c = L::set1(cellCount);
+		const F cMinusOne = L::set1(cellCount - 1.0f);
+		const F cSquared = L::set1(cellCount * cellCount);
+
+		int i = 0;
+		for (; i + L::Width <= count; i += L::Width)
+		{
+			const F pCell[3] = { L::mul(L::load(x + i), c), L::mul(L::load(y + i), c), L::mul(L::load(z + i), c) };
+
+			// Per axis offsets to the 3 neighbor cells and table index of the 27 neighbors, shared by all seeds
+			F tp[3][3];
+			F wrapped[3][3];
+			for (int a = 0; a < 3; a++)
+			{
+				const F pFloor = L::floor(pCell[a]);
+				const F w = L::sub(pFloor, L::mul(c, L::floor(L::div(pFloor, c))));	// glm::mod
+				const F wPlusOne = L::add(w, one);
+				wrapped[a][0] = L::select(L::cmplt(w, one), cMinusOne, L::sub(w, one));
+				wrapped[a][1] = w;
+				wrapped[a][2] = L::select(L::cmpge(wPlusOne, c), zero, wPlusOne);
+				for (int o = 0; o < 3; o++)
+					tp[a][o] = L::sub(pCell[a], L::add(pFloor, L::set1(float(o - 1))));
+			}
+			F cells[27];
+			for (int n = 0; n < 27; n++)
+			{
+				const int xo = n / 9, yo = (n / 3) % 3, zo = n % 3;
+				cells[n] = L::add(L::mul(wrapped[2][zo], cSquared), L::add(L::mul(wrapped[1][yo], c), wrapped[0][xo]));
+			}
+
+			for (int k = 0; k < seedCount; k++)
+			{
+				F d = L::set1(1.0e10f);
+				for (int n = 0; n < 27; n++)
+				{
+					const F h = L::gather(cellTables[k], cells[n]);
+					const F dx = L::sub(tp[0][n / 9], h);
+					const F dy = L::sub(tp[1][(n / 3) % 3], h);
+					const F dz = L::sub(tp[2][n % 3], h);
+					d = L::min(d, L::add(L::add(L::mul(dx, dx), L::mul(dy, dy)), L::mul(dz, dz)));
+				}
+				L::store(out + size_t(k) * count + i, L::max(L::min(d, one), zero));
+			}
+		}
+		return i;
+	}
+
+	/// a + t * (b - a)
+	template<typename L>
+	typename L::F Lerp(typename L::F a, typename L::F b, typename L::F t)
+	{
+		return L::add(a, L::mul(t, L::sub(b, a)));
+	}
+
+	/// One octave of PerlinNoiseBatch at p, already scaled by the frequency.
+	template<typename L>
+	typename L::F PerlinOctave(const PerlinTables& tables, const typename L::F p[3], float period)
+	{
+		typedef typename L::F F;
+
+		const F one = L::set1(1.0f);
+		const F zero = L::set1(0.0f);
+		const F periodF = L::set1(period);
+		const F tableSize = L::set1(256.0f);
+		const F invTableSize = L::set1(1.0f / 256.0f);
+
+		F i0[3], i1[3], f[3], u[3];
+		for (int a = 0; a < 3; a++)
+		{
+			const F pFloor = L::floor(p[a]);
+			const F w0 = L::sub(pFloor, L::mul(periodF, L::floor(L::div(pFloor, periodF))));
+			const F w1Unwrapped = L::add(w0, one);
+			const F w1 = L::select(L::cmpge(w1Unwrapped, periodF), zero, w1Unwrapped);
+			i0[a] = L::sub(w0, L::mul(tableSize, L::floor(L::mul(w0, invTableSize))));
+			i1[a] = L::sub(w1, L::mul(tableSize, L::floor(L::mul(w1, invTableSize))));
+			f[a] = L::sub(p[a], pFloor);
+			const F t = f[a];
+			u[a] = L::mul(L::mul(L::mul(t, t), t), L::add(L::mul(t, L::sub(L::mul(t, L::set1(6.0f)), L::set1(15.0f))), L::set1(10.0f)));
+		}
+
+		F corner[8];
+		for (int c = 0; c < 8; c++)
+		{
+			const int cx = c & 1, cy = (c >> 1) & 1, cz = c >> 2;
+			const F hx = L::gather(tables.perm, cx ? i1[0] : i0[0]);
+			const F hy = L::gather(tables.perm, L::add(hx, cy ? i1[1] : i0[1]));
+			const F h = L::add(hy, cz ? i1[2] : i0[2]);
+			const F dx = L::sub(f[0], L::set1(float(cx)));
+			const F dy = L::sub(f[1], L::set1(float(cy)));
+			const F dz = L::sub(f[2], L::set1(float(cz)));
+			corner[c] = L::add(L::add(L::mul(L::gather(tables.gradX, h), dx), L::mul(L::gather(tables.gradY, h), dy)), L::mul(L::gather(tables.gradZ, h), dz));
+		}
+
+		const F x00 = Lerp<L>(corner[0], corner[1], u[0]);
+		const F x10 = Lerp<L>(corner[2], corner[3], u[0]);
+		const F x01 = Lerp<L>(corner[4], corner[5], u[0]);
+		const F x11 = Lerp<L>(corner[6], corner[7], u[0]);
+		return Lerp<L>(Lerp<L>(x00, x10, u[1]), Lerp<L>(x01, x11, u[1]), u[2]);
+	}
+
+	///
+	/// Batched periodic 3d gradient noise, same math as Tileable3dNoise::PerlinNoise3d.
+	/// Evaluates the largest multiple of L::Width points and returns how many were processed, the caller does the remainder.
+	///
+	template<typename L>
+	int PerlinNoiseBatch(const float* x, const float* y, const float* z, float* out, int count, float frequency, int octaveCount, const PerlinTables& tables)
+	{
+		typedef typename L::F F;
+
+		int i = 0;
+		for (; i + L::Width <= count; i += L::Width)
+		{
+			const F p[3] = { L::load(x + i), L::load(y + i), L::load(z + i) };
+
+			F sum = L::set1(0.0f);
+			float weightSum = 0.0f;
+			float weight = 0.5f;
+			float octaveFrequency = frequency;
+			for (int oct = 0; oct < octaveCount; oct++)
+			{
+				const F freq = L::set1(octaveFrequency);
+				const F pOctave[3] = { L::mul(p[0], freq), L::mul(p[1], freq), L::mul(p[2], freq) };
+				sum = L::add(sum, L::mul(PerlinOctave<L>(tables, pOctave, octaveFrequency), L::set1(weight)));
+				weightSum += weight;
+
+				weight *= weight;
+				octaveFrequency *= 2.0f;
+			}
+
+			F noise = L::add(L::mul(L::div(sum, L::set1(weightSum)), L::set1(0.5f)), L::set1(0.5f));
+			noise = L::max(L::min(noise, L::set1(1.0f)), L::set1(0.0f));
+			L::store(out + i, noise);
+		}
+		return i;
+	}
+
+	///
+	/// Batched Tileable3dNoise::QuantizeUnorm8Batch for 1 or 4 channels, 0 being returned for other channel counts.
+	/// Processes the largest multiple of L::Width texels and returns how many were processed, the caller does the remainder.
+	///
+	template<typename L>
+	int QuantizeUnorm8Batch(const float* const* planes, int channelCount, int count, const float* bias, bool round, unsigned char* out)
+	{
+		typedef typename L::F F;
+
+		if (channelCount != 1 && channelCount != 4)
+			return 0;
+		const F zero = L::set1(0.0f);
+		const F scale = L::set1(255.0f);
+		int i = 0;
+		for (; i + L::Width <= count; i += L::Width)
+		{
+			F c[4];
+			for (int k = 0; k < channelCount; k++)
+			{
+				F x = L::mul(L::load(planes[k] + i), scale);
+				if (bias)
+					x = L::add(x, L::load(bias + i));
+				x = L::max(L::min(x, scale), zero);
+				c[k] = round ? L::round(x) : x;
+			}
+			if (channelCount == 1)
+				L::storeBytes(out + i, c[0]);
+			else
+				L::storeRgba(out + size_t(i) * 4, c[0], c[1], c[2], c[3]);
+		}
+		return i;
+	}
+
+	template<typename L>
+	void WorleyCellSweep(const float* termsX, int lx, const float* termsY, int ly, const float* termsZ, int lz,
+		const int* neighbors, int neighborCount, float* out, int rowPitch, int slicePitch)
+	{
+		typedef typename L::F F;
+
+		const F zero = L::set1(0.0f);
+		const F one = L::set1(1.0f);
+		for (int k = 0; k < lz; k++)
+		{
+			for (int j = 0; j < ly; j++)
+			{
+				float* dst = out + k * slicePitch + j * rowPitch;
+				int i = 0;
+				for (; i + L::Width <= lx; i += L::Width)
+				{
+					F d = L::set1(1.0e10f);
+					for (int c = 0; c < neighborCount; c++)
+					{
+						const int n = neighbors[c];
+						const F dist = L::add(L::add(L::load(termsX + n * lx + i), L::set1(termsY[n * ly + j])), L::set1(termsZ[n * lz + k]));
+						d = L::min(d, dist);
+					}
+					L::store(dst + i, L::max(L::min(d, one), zero));
+				}
+				WorleyCellSweepRow(termsX, lx, termsY, ly, termsZ, lz, j, k, neighbors, neighborCount, dst, i, lx);
+			}
+		}
+	}
+
+#endif
+
+}
+
+#endif // D_TILEABLE3DNOISE_SIMD
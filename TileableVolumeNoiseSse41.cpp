@@ -0,0 +1,65 @@
+// SSE4.1 kernels, selected at runtime by Tileable3dNoise when the CPU supports them.
+// Built without global instruction set flags: MSVC accepts SSE4.1 intrinsics as is, GCC and Clang use a target pragma.
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+// No FMA contraction so that results stay identical to the scalar code
+#if defined(_MSC_VER)
+#pragma fp_contract(off)
+#endif
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("sse4.1"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#pragma GCC target("sse4.1")
+#endif
+
+#define TILEABLENOISE_SIMD_SSE41
+#include "TileableVolumeNoiseSimd.h"
+
+namespace TileableNoiseSimd
+{
+
+	static int WorleyNoiseBatchSse41(const float* x, const float* y, const float* z, float* out, int count, const float* cellTable, float cellCount)
+	{
+		return WorleyNoiseBatch<Lanes4>(x, y, z, out, count, cellTable, cellCount);
+	}
+
+	static int WorleyNoiseBatchSeedsSse41(const float* x, const float* y, const float* z, float* out, int count, const float* const* cellTables, int seedCount, float cellCount)
+	{
+		return WorleyNoiseBatchSeeds<Lanes4>(x, y, z, out, count, cellTables, seedCount, cellCount);
+	}
+
+	static void WorleyCellSweepSse41(const float* termsX, int lx, const float* termsY, int ly, const float* termsZ, int lz,
+		const int* neighbors, int neighborCount, float* out, int rowPitch, int slicePitch)
+	{
+		WorleyCellSweep<Lanes4>(termsX, lx, termsY, ly, termsZ, lz, neighbors, neighborCount, out, rowPitch, slicePitch);
+	}
+
+	static int PerlinNoiseBatchSse41(const float* x, const float* y, const float* z, float* out, int count, float frequency, int octaveCount, const PerlinTables& tables)
+	{
+		return PerlinNoiseBatch<Lanes4>(x, y, z, out, count, frequency, octaveCount, tables);
+	}
+
+	static int FloatToHalfBatchSse41(const float*, unsigned short*, int)
+	{
+		// No F16C with SSE4.1 alone, the caller converts everything
+		return 0;
+	}
+
+	static int QuantizeUnorm8BatchSse41(const float* const* planes, int channelCount, int count, const float* bias, bool round, unsigned char* out)
+	{
+		return QuantizeUnorm8Batch<Lanes4>(planes, channelCount, count, bias, round, out);
+	}
+
+	const Kernels KernelsSse41 = { WorleyNoiseBatchSse41, WorleyCellSweepSse41, WorleyNoiseBatchSeedsSse41, PerlinNoiseBatchSse41, FloatToHalfBatchSse41, QuantizeUnorm8BatchSse41 };
+
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#endif
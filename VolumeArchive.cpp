@@ -0,0 +1,472 @@
+
+#include "VolumeArchive.h"
+
+#include "glm/common.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+
+static_assert(sizeof(VolumeArchive::Header) == 1024, "the header layout is part of the file format");
+static_assert(sizeof(VolumeArchive::IndexEntry) == 16, "the index layout is part of the file format");
+
+namespace
+{
+
+	const char Magic[8] = { 'T', 'V', 'N', 'A', 'R', 'C', 0, 0 };
+
+	const size_t MinMatch = 4;
+	const size_t MaxOffset = 65535;
+	const int HashBits = 14;
+
+	bool Seek(FILE* file, uint64_t offset)
+	{
+#ifdef _WIN32
+		return _fseeki64(file, int64_t(offset), SEEK_SET) == 0;
+#else
+		return fseeko(file, off_t(offset), SEEK_SET) == 0;
+#endif
+	}
+
+	uint64_t FileSize(FILE* file)
+	{
+#ifdef _WIN32
+		return _fseeki64(file, 0, SEEK_END) == 0 ? uint64_t(_ftelli64(file)) : 0;
+#else
+		return fseeko(file, 0, SEEK_END) == 0 ? uint64_t(ftello(file)) : 0;
+#endif
+	}
+
+	uint32_t Read32(const uint8_t* p)
+	{
+		uint32_t value;
+		memcpy(&value, p, 4);
+		return value;
+	}
+
+	void AppendLength(std::vector<uint8_t>& out, size_t length)
+	{
+		for (; length >= 255; length -= 255)
+			out.push_back(255);
+		out.push_back(uint8_t(length));
+	}
+
+	// Sequences of a token (literal count and match length - 4 on 4 bits each, 15 meaning that bytes of 255 and a last one
+	// smaller follow), the literals, then a 16 bit offset back from the current position and the match length extension.
+	// The last sequence only has literals and ends the brick.
+	void LzCompress(const uint8_t* in, size_t size, std::vector<uint8_t>& out)
+	{
+		std::vector<int64_t> table(size_t(1) << HashBits, -1);
+		size_t anchor = 0;
+		size_t i = 0;
+		while (i + MinMatch <= size)
+		{
+			const uint32_t bytes = Read32(in + i);
+			const uint32_t hash = (bytes * 2654435761u) >> (32 - HashBits);
+			const int64_t candidate = table[hash];
+			table[hash] = int64_t(i);
+			if (candidate < 0 || i - size_t(candidate) > MaxOffset || Read32(in + candidate) != bytes)
+			{
+				i++;
+				continue;
+			}
+
+			size_t length = MinMatch;
+			while (i + length < size && in[candidate + length] == in[i + length])
+				length++;
+			const size_t literals = i - anchor;
+			out.push_back(uint8_t((std::min<size_t>(literals, 15) << 4) | std::min<size_t>(length - MinMatch, 15)));
+			if (literals >= 15)
+				AppendLength(out, literals - 15);
+			out.insert(out.end(), in + anchor, in + i);
+			const size_t offset = i - size_t(candidate);
+			out.push_back(uint8_t(offset));
+			out.push_back(uint8_t(offset >> 8));
+			if (length - MinMatch >= 15)
+				AppendLength(out, length - MinMatch - 15);
+			i += length;
+			anchor = i;
+		}
+		if (anchor < size)
+		{
+			const size_t literals = size - anchor;
+			out.push_back(uint8_t(std::min<size_t>(literals, 15) << 4));
+			if (literals >= 15)
+				AppendLength(out, literals - 15);
+			out.insert(out.end(), in + anchor, in + size);
+		}
+	}
+
+	bool LzDecompress(const uint8_t* in, size_t inSize, uint8_t* out, size_t outSize)
+	{
+		size_t ip = 0;
+		size_t op = 0;
+		auto readLength = [&](size_t& length)
+		{
+			uint8_t byte;
+			do
+			{
+				if (ip >= inSize)
+					return false;
+				byte = in[ip++];
+				length += byte;
+			} while (byte == 255);
+			return true;
+		};
+
+		while (op < outSize)
+		{
+			if (ip >= inSize)
+				return false;
+			const uint8_t token = in[ip++];
+			size_t literals = token >> 4;
+			if (literals == 15 && !readLength(literals))
+				return false;
+			if (literals > inSize - ip || literals > outSize - op)
+				return false;
+			memcpy(out + op, in + ip, literals);
+			ip += literals;
+			op += literals;
+			if (op == outSize)
+				break;
+
+			if (inSize - ip < 2)
+				return false;
+			const size_t offset = in[ip] | (size_t(in[ip + 1]) << 8);
+			ip += 2;
+			size_t length = token & 15;
+			if (length == 15 && !readLength(length))
+				return false;
+			length += MinMatch;
+			if (offset == 0 || offset > op || length > outSize - op)
+				return false;
+			// Byte by byte since the match may overlap the bytes it produces
+			for (size_t k = 0; k < length; k++, op++)
+				out[op] = out[op - offset];
+		}
+		return ip == inSize;
+	}
+
+	void ToDeltaPlanes(const uint8_t* texels, size_t count, size_t texelSize, uint8_t* planes)
+	{
+		for (size_t b = 0; b < texelSize; b++)
+		{
+			uint8_t previous = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				const uint8_t value = texels[i * texelSize + b];
+				planes[b * count + i] = uint8_t(value - previous);
+				previous = value;
+			}
+		}
+	}
+
+	void FromDeltaPlanes(const uint8_t* planes, size_t count, size_t texelSize, uint8_t* texels)
+	{
+		for (size_t b = 0; b < texelSize; b++)
+		{
+			uint8_t value = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				value = uint8_t(value + planes[b * count + i]);
+				texels[i * texelSize + b] = value;
+			}
+		}
+	}
+
+	// Copies the texels of range between a brick and a buffer of slices of width x height texels starting at slice firstSlice
+	void CopyBrick(const Range3d& range, int width, int height, int firstSlice, size_t texelSize, uint8_t* slices, uint8_t* brick, bool toBrick)
+	{
+		const size_t rowSize = size_t(range.end.x - range.begin.x) * texelSize;
+		for (int z = range.begin.z; z < range.end.z; z++)
+			for (int y = range.begin.y; y < range.end.y; y++, brick += rowSize)
+			{
+				uint8_t* row = slices + ((size_t(z - firstSlice) * height + y) * width + range.begin.x) * texelSize;
+				if (toBrick)
+					memcpy(brick, row, rowSize);
+				else
+					memcpy(row, brick, rowSize);
+			}
+	}
+
+	bool DecodeBrick(const uint8_t* data, const VolumeArchive::IndexEntry& entry, VolumeArchive::Filter filter, size_t texelSize, uint8_t* texels)
+	{
+		std::vector<uint8_t> filtered;
+		uint8_t* decoded = texels;
+		if (filter == VolumeArchive::Filter::Delta)
+		{
+			filtered.resize(entry.size);
+			decoded = filtered.data();
+		}
+		if (entry.compressedSize == entry.size)
+			memcpy(decoded, data, entry.size);
+		else if (!LzDecompress(data, entry.compressedSize, decoded, entry.size))
+			return false;
+		if (filter == VolumeArchive::Filter::Delta)
+			FromDeltaPlanes(filtered.data(), entry.size / texelSize, texelSize, texels);
+		return true;
+	}
+
+}
+
+bool VolumeArchive::Writer::Begin(const char* fileName, int size, int channelCount, VolumeFile::ElementType elementType, int brickSize,
+	Filter filter, const std::string& parameters)
+{
+	if ((channelCount != 1 && channelCount != 4) || VolumeFile::GetElementSize(elementType) == 0 || brickSize <= 0)
+		return false;
+	// IndexEntry sizes are 32 bits
+	const uint64_t brickExtent = uint64_t(std::min(brickSize, size));
+	if (brickExtent * brickExtent * brickExtent * channelCount * VolumeFile::GetElementSize(elementType) > UINT32_MAX)
+		return false;
+	mFile = fopen(fileName, "wb");
+	if (!mFile)
+		return false;
+
+	memset(&mHeader, 0, sizeof(mHeader));
+	memcpy(mHeader.magic, Magic, sizeof(Magic));
+	mHeader.version = Version;
+	mHeader.headerSize = sizeof(Header);
+	mHeader.width = mHeader.height = mHeader.depth = uint32_t(size);
+	mHeader.channelCount = uint32_t(channelCount);
+	mHeader.elementType = elementType;
+	mHeader.elementSize = VolumeFile::GetElementSize(elementType);
+	mHeader.brickSize = uint32_t(brickSize);
+	mHeader.filter = filter;
+	const uint32_t brickCount = uint32_t((size + brickSize - 1) / brickSize);
+	mHeader.brickCounts[0] = mHeader.brickCounts[1] = mHeader.brickCounts[2] = brickCount;
+	mHeader.dataOffset = sizeof(Header) + sizeof(IndexEntry) * uint64_t(brickCount) * brickCount * brickCount;
+	mHeader.volumeHash = VolumeFile::Hash(nullptr, 0);
+	strcpy(mHeader.channels, channelCount == 1 ? "R" : "RGBA");
+	strncpy(mHeader.parameters, parameters.c_str(), sizeof(mHeader.parameters) - 1);
+
+	mIndex.assign(size_t(brickCount) * brickCount * brickCount, IndexEntry());
+	mSlices.resize(GetSlabSize(size, size_t(channelCount) * mHeader.elementSize, brickSize));
+	mSliceCount = 0;
+	mNextSlice = 0;
+	mOffset = mHeader.dataOffset;
+	mFailed = false;
+
+	// The header and the index are written again by End()
+	std::vector<uint8_t> prefix(size_t(mHeader.dataOffset), 0);
+	memcpy(prefix.data(), &mHeader, sizeof(mHeader));
+	if (fwrite(prefix.data(), prefix.size(), 1, mFile) != 1)
+	{
+		fclose(mFile);
+		mFile = nullptr;
+		return false;
+	}
+	return true;
+}
+
+bool VolumeArchive::Writer::WriteSlices(TaskScheduler& scheduler, int sliceCount, const void* texels)
+{
+	if (!mFile || mNextSlice + sliceCount > int(mHeader.depth))
+		return false;
+	const size_t sliceSize = size_t(mHeader.width) * mHeader.height * mHeader.channelCount * mHeader.elementSize;
+	const uint8_t* slice = (const uint8_t*)texels;
+	mHeader.volumeHash = VolumeFile::Hash(slice, sliceSize * sliceCount, mHeader.volumeHash);
+	for (int z = 0; z < sliceCount; z++, slice += sliceSize)
+	{
+		memcpy(&mSlices[mSliceCount * sliceSize], slice, sliceSize);
+		mSliceCount++;
+		mNextSlice++;
+		if (mSliceCount == int(mHeader.brickSize) || mNextSlice == int(mHeader.depth))
+			mFailed |= !WriteBrickRow(scheduler);
+	}
+	return !mFailed;
+}
+
+bool VolumeArchive::Writer::WriteBrickRow(TaskScheduler& scheduler)
+{
+	const int brickSize = int(mHeader.brickSize);
+	const int bricksX = int(mHeader.brickCounts[0]);
+	const int bricksY = int(mHeader.brickCounts[1]);
+	const int brickZ = (mNextSlice - 1) / brickSize;
+	const int firstSlice = brickZ * brickSize;
+	const size_t texelSize = size_t(mHeader.channelCount) * mHeader.elementSize;
+
+	std::vector<std::vector<uint8_t>> bricks(size_t(bricksX) * bricksY);
+	scheduler.ParallelFor3d(Range3d(glm::ivec3(0), glm::ivec3(bricksX, bricksY, 1)), glm::ivec3(1), [&](const Range3d& block)
+	{
+		const int x = block.begin.x;
+		const int y = block.begin.y;
+		const glm::ivec3 begin(x * brickSize, y * brickSize, firstSlice);
+		const Range3d range(begin, glm::min(begin + glm::ivec3(brickSize), glm::ivec3(int(mHeader.width), int(mHeader.height), mNextSlice)));
+		const size_t count = size_t(range.volume());
+
+		std::vector<uint8_t> texels(count * texelSize);
+		CopyBrick(range, int(mHeader.width), int(mHeader.height), firstSlice, texelSize, mSlices.data(), texels.data(), true);
+		if (mHeader.filter == Filter::Delta)
+		{
+			std::vector<uint8_t> planes(texels.size());
+			ToDeltaPlanes(texels.data(), count, texelSize, planes.data());
+			texels.swap(planes);
+		}
+
+		// Bricks that do not compress are stored as is
+		std::vector<uint8_t>& brick = bricks[size_t(y) * bricksX + x];
+		LzCompress(texels.data(), texels.size(), brick);
+		if (brick.size() >= texels.size())
+			brick.swap(texels);
+		IndexEntry& entry = mIndex[(size_t(brickZ) * bricksY + y) * bricksX + x];
+		entry.size = uint32_t(count * texelSize);
+		entry.compressedSize = uint32_t(brick.size());
+	});
+
+	mSliceCount = 0;
+	for (int y = 0; y < bricksY; y++)
+		for (int x = 0; x < bricksX; x++)
+		{
+			const std::vector<uint8_t>& brick = bricks[size_t(y) * bricksX + x];
+			mIndex[(size_t(brickZ) * bricksY + y) * bricksX + x].offset = mOffset;
+			mOffset += brick.size();
+			if (fwrite(brick.data(), brick.size(), 1, mFile) != 1)
+				return false;
+		}
+	return true;
+}
+
+bool VolumeArchive::Writer::End()
+{
+	if (!mFile)
+		return false;
+	const bool complete = !mFailed && mNextSlice == int(mHeader.depth) && Seek(mFile, 0)
+		&& fwrite(&mHeader, sizeof(mHeader), 1, mFile) == 1
+		&& fwrite(mIndex.data(), sizeof(IndexEntry), mIndex.size(), mFile) == mIndex.size();
+	const bool closed = fclose(mFile) == 0;
+	mFile = nullptr;
+	return complete && closed;
+}
+
+size_t VolumeArchive::Writer::GetSlabSize(int size, size_t texelSize, int brickSize)
+{
+	return size_t(std::min(brickSize, size)) * size * size * texelSize;
+}
+
+bool VolumeArchive::Reader::Open(const char* fileName, std::string& error)
+{
+	Close();
+	error = std::string(fileName) + ": ";
+	mFile = fopen(fileName, "rb");
+	if (!mFile)
+	{
+		error += "cannot open the file";
+		return false;
+	}
+
+	const char* invalid = nullptr;
+	const Header& h = mHeader;
+	if (fread(&mHeader, sizeof(mHeader), 1, mFile) != 1 || memcmp(h.magic, Magic, sizeof(Magic)) != 0)
+		invalid = "not a volume archive";
+	else if (h.version > Version || h.headerSize < sizeof(Header))
+		invalid = "unsupported version";
+	else if (VolumeFile::GetElementSize(h.elementType) == 0)
+		invalid = "unknown element type";
+	else if (h.elementSize != VolumeFile::GetElementSize(h.elementType))
+		invalid = "element size does not match the element type";
+	else if (h.channelCount != 1 && h.channelCount != 4)
+		invalid = "unsupported channel count";
+	else if (h.filter != Filter::None && h.filter != Filter::Delta)
+		invalid = "unknown filter";
+	else if (h.brickSize == 0 || h.width == 0 || h.height == 0 || h.depth == 0
+		|| h.brickCounts[0] != (h.width + h.brickSize - 1) / h.brickSize
+		|| h.brickCounts[1] != (h.height + h.brickSize - 1) / h.brickSize
+		|| h.brickCounts[2] != (h.depth + h.brickSize - 1) / h.brickSize)
+		invalid = "inconsistent dimensions";
+	const uint64_t fileSize = invalid ? 0 : FileSize(mFile);
+	if (!invalid)
+	{
+		// Bounds the entry count by the file size before multiplying, the index is allocated from it
+		const uint64_t maxEntries = fileSize > h.headerSize ? (fileSize - h.headerSize) / sizeof(IndexEntry) : 0;
+		const uint64_t sliceEntries = uint64_t(h.brickCounts[0]) * h.brickCounts[1];
+		if (h.brickCounts[2] > maxEntries / sliceEntries)
+			invalid = "truncated index";
+		else if (h.dataOffset != h.headerSize + sizeof(IndexEntry) * sliceEntries * h.brickCounts[2])
+			invalid = "inconsistent dimensions";
+	}
+	if (!invalid)
+	{
+		mIndex.resize(size_t(h.brickCounts[0]) * h.brickCounts[1] * h.brickCounts[2]);
+		if (!Seek(mFile, h.headerSize) || fread(mIndex.data(), sizeof(IndexEntry), mIndex.size(), mFile) != mIndex.size())
+			invalid = "truncated index";
+	}
+	const size_t texelSize = size_t(h.channelCount) * h.elementSize;
+	for (size_t i = 0; i < mIndex.size() && !invalid; i++)
+	{
+		const int x = int(i % h.brickCounts[0]);
+		const int y = int(i / h.brickCounts[0] % h.brickCounts[1]);
+		const int z = int(i / (size_t(h.brickCounts[0]) * h.brickCounts[1]));
+		const IndexEntry& entry = mIndex[i];
+		if (entry.size != GetBrickRange(x, y, z).volume() * texelSize || entry.compressedSize > entry.size || entry.offset < h.dataOffset
+			|| entry.offset > fileSize || entry.compressedSize > fileSize - entry.offset)
+			invalid = "corrupted index";
+	}
+	if (invalid)
+	{
+		error += invalid;
+		Close();
+		return false;
+	}
+	error.clear();
+	return true;
+}
+
+void VolumeArchive::Reader::Close()
+{
+	if (mFile)
+		fclose(mFile);
+	mFile = nullptr;
+	mIndex.clear();
+}
+
+const VolumeArchive::IndexEntry& VolumeArchive::Reader::GetIndexEntry(int x, int y, int z) const
+{
+	return mIndex[(size_t(z) * mHeader.brickCounts[1] + y) * mHeader.brickCounts[0] + x];
+}
+
+Range3d VolumeArchive::Reader::GetBrickRange(int x, int y, int z) const
+{
+	const glm::ivec3 begin = glm::ivec3(x, y, z) * int(mHeader.brickSize);
+	return Range3d(begin, glm::min(begin + int(mHeader.brickSize), glm::ivec3(int(mHeader.width), int(mHeader.height), int(mHeader.depth))));
+}
+
+bool VolumeArchive::Reader::ReadBrick(int x, int y, int z, std::vector<uint8_t>& texels)
+{
+	const IndexEntry& entry = GetIndexEntry(x, y, z);
+	std::vector<uint8_t> data(entry.compressedSize);
+	texels.resize(entry.size);
+	return mFile && Seek(mFile, entry.offset) && fread(data.data(), 1, data.size(), mFile) == data.size()
+		&& DecodeBrick(data.data(), entry, mHeader.filter, size_t(mHeader.channelCount) * mHeader.elementSize, texels.data());
+}
+
+bool VolumeArchive::Reader::ReadVolume(TaskScheduler& scheduler, std::vector<uint8_t>& texels)
+{
+	if (!mFile)
+		return false;
+
+	// Bricks are stored one after the other, a single read gets them all
+	uint64_t dataEnd = mHeader.dataOffset;
+	for (const IndexEntry& entry : mIndex)
+		dataEnd = std::max(dataEnd, entry.offset + entry.compressedSize);
+	std::vector<uint8_t> data(size_t(dataEnd - mHeader.dataOffset));
+	if (!Seek(mFile, mHeader.dataOffset) || fread(data.data(), 1, data.size(), mFile) != data.size())
+		return false;
+
+	const size_t texelSize = size_t(mHeader.channelCount) * mHeader.elementSize;
+	texels.resize(size_t(mHeader.width) * mHeader.height * mHeader.depth * texelSize);
+	std::atomic<bool> corrupted(false);
+	const glm::ivec3 brickCounts(int(mHeader.brickCounts[0]), int(mHeader.brickCounts[1]), int(mHeader.brickCounts[2]));
+	scheduler.ParallelFor3d(Range3d(glm::ivec3(0), brickCounts), glm::ivec3(1), [&](const Range3d& block)
+	{
+		const IndexEntry& entry = GetIndexEntry(block.begin.x, block.begin.y, block.begin.z);
+		std::vector<uint8_t> brick(entry.size);
+		if (!DecodeBrick(&data[size_t(entry.offset - mHeader.dataOffset)], entry, mHeader.filter, texelSize, brick.data()))
+		{
+			corrupted = true;
+			return;
+		}
+		CopyBrick(GetBrickRange(block.begin.x, block.begin.y, block.begin.z), int(mHeader.width), int(mHeader.height), 0, texelSize,
+			texels.data(), brick.data(), false);
+	});
+	return !corrupted;
+}
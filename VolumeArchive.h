@@ -0,0 +1,137 @@
+#ifndef D_VOLUMEARCHIVE
+#define D_VOLUMEARCHIVE
+
+#include "TaskScheduler.h"
+#include "VolumeFile.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+///
+/// Volume archives (*.varc): volumes split in bricks compressed independently, for storage. The header is followed by
+/// an index giving the offset and compressed size of every brick, then the bricks. Each brick holds its texels with x
+/// the fastest varying index, optionally rearranged in byte planes delta encoded along the brick, compressed with a
+/// small LZ77 codec (LZ4 like sequences of literals and matches of at least 4 bytes within 64 KiB). Bricks are
+/// compressed and decompressed in parallel, and a single brick can be read without touching the others.
+/// Little endian only.
+///
+class VolumeArchive
+{
+public:
+
+	static const uint32_t Version = 1;
+
+	enum class Filter : uint32_t
+	{
+		None = 0,
+		Delta = 1,		///< Byte planes, each byte being the difference with the previous texel of the brick.
+	};
+
+	struct Header
+	{
+		char magic[8];					///< "TVNARC" followed by 2 null bytes.
+		uint32_t version;
+		uint32_t headerSize;			///< sizeof(Header), the index starts there.
+		uint32_t width;
+		uint32_t height;
+		uint32_t depth;
+		uint32_t channelCount;
+		VolumeFile::ElementType elementType;
+		uint32_t elementSize;
+		uint32_t brickSize;				///< Bricks on the far edges are smaller when the size is not a multiple of it.
+		Filter filter;
+		uint32_t brickCounts[3];		///< Along x, y and z. Brick (x, y, z) is entry (z * by + y) * bx + x of the index.
+		uint32_t reserved;
+		uint64_t dataOffset;			///< Offset of the first brick, after the index.
+		uint64_t volumeHash;			///< VolumeFile::Hash of all the texels in volume order.
+		char channels[16];				///< Channel layout, "RGBA" or "R", null terminated.
+		char parameters[928];			///< Generator parameters, null terminated.
+	};
+
+	struct IndexEntry
+	{
+		uint64_t offset;
+		uint32_t compressedSize;		///< Equal to size when the brick is stored uncompressed.
+		uint32_t size;
+	};
+
+	///
+	/// Writes archives progressively like VolumeFile::Writer. The slices of a row of bricks along z are gathered, then its
+	/// bricks are compressed in parallel and appended once the row is complete.
+	///
+	class Writer
+	{
+	public:
+
+		Writer() : mFile(nullptr) {}
+
+		/// @param channelCount 1 or 4.
+		/// @return false if the file cannot be created, or if a brick would exceed 4 GiB.
+		bool Begin(const char* fileName, int size, int channelCount, VolumeFile::ElementType elementType, int brickSize, Filter filter,
+			const std::string& parameters);
+
+		/// Appends sliceCount slices of size^2 texels.
+		bool WriteSlices(TaskScheduler& scheduler, int sliceCount, const void* texels);
+
+		/// @return false if fewer slices than the size were written or the file could not be completed.
+		bool End();
+
+		/// @return the bytes of the slices a writer gathers for a row of bricks, kept from Begin() to End().
+		static size_t GetSlabSize(int size, size_t texelSize, int brickSize);
+
+	private:
+
+		bool WriteBrickRow(TaskScheduler& scheduler);
+
+		FILE* mFile;
+		Header mHeader;
+		std::vector<IndexEntry> mIndex;
+		std::vector<uint8_t> mSlices;		///< Slices of the row of bricks being gathered.
+		int mSliceCount;
+		int mNextSlice;
+		uint64_t mOffset;
+		bool mFailed;
+	};
+
+	///
+	/// Reads the header and index of an archive, then bricks on demand.
+	///
+	class Reader
+	{
+	public:
+
+		Reader() : mFile(nullptr) {}
+		~Reader() { Close(); }
+
+		/// @return false with a message if the file cannot be read or its header is invalid.
+		bool Open(const char* fileName, std::string& error);
+		void Close();
+
+		const Header& GetHeader() const { return mHeader; }
+		const IndexEntry& GetIndexEntry(int x, int y, int z) const;
+
+		/// @return the texels covered by brick (x, y, z).
+		Range3d GetBrickRange(int x, int y, int z) const;
+
+		/// Reads and decompresses brick (x, y, z) alone, GetBrickRange(x, y, z).volume() texels.
+		/// @return false if the brick is corrupted.
+		bool ReadBrick(int x, int y, int z, std::vector<uint8_t>& texels);
+
+		/// Reads all the bricks at once and decompresses them in parallel into the texels of the whole volume.
+		/// @return false if a brick is corrupted.
+		bool ReadVolume(TaskScheduler& scheduler, std::vector<uint8_t>& texels);
+
+	private:
+
+		Reader(const Reader&) = delete;
+		Reader& operator=(const Reader&) = delete;
+
+		FILE* mFile;
+		Header mHeader;
+		std::vector<IndexEntry> mIndex;
+	};
+};
+
+#endif // D_VOLUMEARCHIVE
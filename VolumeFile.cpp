@@ -0,0 +1,232 @@
+
+#include "VolumeFile.h"
+
+#include <string.h>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(VolumeFile::Header) == 1024, "the header layout is part of the file format");
+
+namespace
+{
+
+	const char Magic[8] = { 'T', 'V', 'N', 'V', 'O', 'L', 0, 0 };
+
+	/// @return the product of the dimensions of the header and the size of a texel, or UINT64_MAX if it overflows.
+	uint64_t GetTexelBytes(const VolumeFile::Header& header)
+	{
+		const uint64_t factors[4] = { header.height, header.depth, header.channelCount, header.elementSize };
+		uint64_t product = header.width;
+		for (uint64_t factor : factors)
+		{
+			if (factor != 0 && product > UINT64_MAX / factor)
+				return UINT64_MAX;
+			product *= factor;
+		}
+		return product;
+	}
+
+}
+
+VolumeFile::VolumeFile() : mData(nullptr), mSize(0)
+#ifdef _WIN32
+	, mFileHandle(INVALID_HANDLE_VALUE), mMappingHandle(nullptr)
+#endif
+{
+}
+
+VolumeFile::~VolumeFile()
+{
+	Close();
+}
+
+bool VolumeFile::Open(const char* fileName, std::string& error)
+{
+	Close();
+	error = std::string(fileName) + ": ";
+
+#ifdef _WIN32
+	mFileHandle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	LARGE_INTEGER fileSize;
+	if (mFileHandle == INVALID_HANDLE_VALUE || !GetFileSizeEx(mFileHandle, &fileSize))
+	{
+		error += "cannot open the file";
+		Close();
+		return false;
+	}
+	mSize = size_t(fileSize.QuadPart);
+	if (mSize >= sizeof(Header))
+	{
+		mMappingHandle = CreateFileMappingA(mFileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		mData = mMappingHandle ? (const uint8_t*)MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	}
+#else
+	const int fd = open(fileName, O_RDONLY);
+	struct stat fileStat;
+	if (fd < 0 || fstat(fd, &fileStat) != 0)
+	{
+		error += "cannot open the file";
+		if (fd >= 0)
+			close(fd);
+		return false;
+	}
+	mSize = size_t(fileStat.st_size);
+	if (mSize >= sizeof(Header))
+	{
+		void* data = mmap(nullptr, mSize, PROT_READ, MAP_SHARED, fd, 0);
+		mData = data != MAP_FAILED ? (const uint8_t*)data : nullptr;
+	}
+	close(fd);
+#endif
+
+	if (mSize < sizeof(Header))
+	{
+		error += "too small for a volume file";
+		Close();
+		return false;
+	}
+	if (!mData)
+	{
+		error += "cannot map the file";
+		Close();
+		return false;
+	}
+
+	const Header& header = GetHeader();
+	const char* invalid = nullptr;
+	if (memcmp(header.magic, Magic, sizeof(Magic)) != 0)
+		invalid = "not a volume file";
+	else if (header.version > Version || header.headerSize < sizeof(Header))
+		invalid = "unsupported version";
+	else if (GetElementSize(header.elementType) == 0)
+		invalid = "unknown element type";
+	else if (header.elementSize != GetElementSize(header.elementType))
+		invalid = "element size does not match the element type";
+	else if (header.channelCount != 1 && header.channelCount != 4)
+		invalid = "unsupported channel count";
+	else if (header.payloadOffset % PayloadAlignment != 0 || header.payloadOffset < header.headerSize
+		|| header.payloadOffset > mSize || header.payloadSize > mSize - header.payloadOffset)
+		invalid = "truncated payload";
+	else if (GetTexelBytes(header) != header.payloadSize)
+		invalid = "payload size does not match the dimensions";
+	if (invalid)
+	{
+		error += invalid;
+		Close();
+		return false;
+	}
+	error.clear();
+	return true;
+}
+
+void VolumeFile::Close()
+{
+#ifdef _WIN32
+	if (mData)
+		UnmapViewOfFile(mData);
+	if (mMappingHandle)
+		CloseHandle(mMappingHandle);
+	if (mFileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(mFileHandle);
+	mMappingHandle = nullptr;
+	mFileHandle = INVALID_HANDLE_VALUE;
+#else
+	if (mData)
+		munmap((void*)mData, mSize);
+#endif
+	mData = nullptr;
+	mSize = 0;
+}
+
+bool VolumeFile::VerifyHash() const
+{
+	if (!mData)
+		return false;
+	const Header& header = GetHeader();
+	return Hash(mData + header.payloadOffset, size_t(header.payloadSize)) == header.payloadHash;
+}
+
+uint64_t VolumeFile::Hash(const void* data, size_t size, uint64_t hash)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	return hash;
+}
+
+uint32_t VolumeFile::GetElementSize(ElementType elementType)
+{
+	switch (elementType)
+	{
+	case ElementType::Unorm8:	return 1;
+	case ElementType::Half:		return 2;
+	case ElementType::Float:	return 4;
+	}
+	return 0;
+}
+
+bool VolumeFile::Writer::Begin(const char* fileName, int size, int channelCount, ElementType elementType, const std::string& parameters)
+{
+	if ((channelCount != 1 && channelCount != 4) || GetElementSize(elementType) == 0)
+		return false;
+	mFile = fopen(fileName, "wb");
+	if (!mFile)
+		return false;
+
+	memset(&mHeader, 0, sizeof(mHeader));
+	memcpy(mHeader.magic, Magic, sizeof(Magic));
+	mHeader.version = Version;
+	mHeader.headerSize = sizeof(Header);
+	mHeader.width = mHeader.height = mHeader.depth = uint32_t(size);
+	mHeader.channelCount = uint32_t(channelCount);
+	mHeader.elementType = elementType;
+	mHeader.elementSize = GetElementSize(elementType);
+	mHeader.payloadOffset = PayloadAlignment;
+	mHeader.payloadSize = uint64_t(size) * size * size * channelCount * mHeader.elementSize;
+	strcpy(mHeader.channels, channelCount == 1 ? "R" : "RGBA");
+	strncpy(mHeader.parameters, parameters.c_str(), sizeof(mHeader.parameters) - 1);
+	mSliceSize = size_t(size) * size * channelCount * mHeader.elementSize;
+	mSlicesLeft = size;
+	mHash = HashBasis;
+
+	// The hash is only known once the texels are written, the header is written again by End()
+	std::vector<uint8_t> prefix(size_t(mHeader.payloadOffset), 0);
+	memcpy(prefix.data(), &mHeader, sizeof(mHeader));
+	if (fwrite(prefix.data(), prefix.size(), 1, mFile) != 1)
+	{
+		fclose(mFile);
+		mFile = nullptr;
+		return false;
+	}
+	return true;
+}
+
+bool VolumeFile::Writer::WriteSlices(int sliceCount, const void* texels)
+{
+	if (!mFile || sliceCount > mSlicesLeft)
+		return false;
+	mSlicesLeft -= sliceCount;
+	mHash = Hash(texels, mSliceSize * sliceCount, mHash);
+	return fwrite(texels, mSliceSize, sliceCount, mFile) == size_t(sliceCount);
+}
+
+bool VolumeFile::Writer::End()
+{
+	if (!mFile)
+		return false;
+	mHeader.payloadHash = mHash;
+	const bool complete = mSlicesLeft == 0 && fseek(mFile, 0, SEEK_SET) == 0 && fwrite(&mHeader, sizeof(mHeader), 1, mFile) == 1;
+	const bool closed = fclose(mFile) == 0;
+	mFile = nullptr;
+	return complete && closed;
+}
@@ -0,0 +1,152 @@
+#ifndef D_VOLUMEFILE
+#define D_VOLUMEFILE
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+///
+/// Volume files (*.vol): a versioned header describing the volume, then the texels starting at a page aligned offset
+/// so that a memory mapping of the file can be used in place. Texels interleave their channels, x being the fastest
+/// varying index then y and z. Little endian only.
+///
+class VolumeFile
+{
+public:
+
+	static const uint32_t Version = 1;
+	static const uint64_t PayloadAlignment = 4096;
+
+	enum class ElementType : uint32_t
+	{
+		Unorm8 = 1,
+		Half = 2,		///< IEEE 754 binary16, viewed as uint16_t.
+		Float = 3,
+	};
+
+	struct Header
+	{
+		char magic[8];				///< "TVNVOL" followed by 2 null bytes.
+		uint32_t version;
+		uint32_t headerSize;		///< sizeof(Header), fields are only ever appended to the header.
+		uint32_t width;
+		uint32_t height;
+		uint32_t depth;
+		uint32_t channelCount;
+		ElementType elementType;
+		uint32_t elementSize;
+		uint64_t payloadOffset;
+		uint64_t payloadSize;
+		uint64_t payloadHash;		///< 64 bit FNV-1a of the payload, see Hash().
+		char channels[16];			///< Channel layout, "RGBA" or "R", null terminated.
+		char parameters[944];		///< Generator parameters, null terminated.
+	};
+
+	/// Typed view of the texels of a mapped file, empty if the element type does not match.
+	template<typename T>
+	struct View
+	{
+		const T* texels;
+		int width;
+		int height;
+		int depth;
+		int channelCount;
+
+		bool empty() const { return texels == nullptr; }
+		const T& at(int x, int y, int z, int channel) const
+		{
+			return texels[((size_t(z) * height + y) * width + x) * channelCount + channel];
+		}
+	};
+
+	VolumeFile();
+	~VolumeFile();
+
+	/// Maps fileName read only. The texels are neither copied nor verified against the hash.
+	/// @return false with a message if the file cannot be mapped or its header is invalid.
+	bool Open(const char* fileName, std::string& error);
+	void Close();
+
+	/// Header of the open file, Open() must have succeeded.
+	const Header& GetHeader() const
+	{
+		assert(mData != nullptr);
+		return *(const Header*)mData;
+	}
+
+	/// @tparam T uint8_t, uint16_t or float for Unorm8, Half or Float texels.
+	template<typename T>
+	View<T> GetView() const
+	{
+		View<T> view = {};
+		if (mData && GetHeader().elementType == ElementTypeOf((const T*)nullptr))
+		{
+			const Header& header = GetHeader();
+			view.texels = (const T*)(mData + header.payloadOffset);
+			view.width = int(header.width);
+			view.height = int(header.height);
+			view.depth = int(header.depth);
+			view.channelCount = int(header.channelCount);
+		}
+		return view;
+	}
+
+	/// @return true if the texels hash to the payloadHash of the header. Reads the whole payload.
+	bool VerifyHash() const;
+
+	static uint64_t Hash(const void* data, size_t size, uint64_t hash = HashBasis);
+
+	/// @return the size in bytes of one channel of a texel, 0 for an unknown element type.
+	static uint32_t GetElementSize(ElementType elementType);
+
+	///
+	/// Writes volume files progressively like ExrWriter: Begin() writes the header, the slices are then passed in order
+	/// over any number of WriteSlices() calls, and End() completes the header with the hash of the texels.
+	///
+	class Writer
+	{
+	public:
+
+		Writer() : mFile(nullptr), mSliceSize(0), mSlicesLeft(0), mHash(HashBasis) {}
+
+		/// @param channelCount 1 or 4.
+		/// @param parameters generator parameters recorded in the header, truncated to fit.
+		/// @return false if the file cannot be created.
+		bool Begin(const char* fileName, int size, int channelCount, ElementType elementType, const std::string& parameters);
+
+		/// Appends sliceCount slices of size^2 texels.
+		bool WriteSlices(int sliceCount, const void* texels);
+
+		/// @return false if fewer slices than the size were written or the file could not be completed.
+		bool End();
+
+	private:
+
+		FILE* mFile;
+		Header mHeader;
+		size_t mSliceSize;
+		int mSlicesLeft;
+		uint64_t mHash;
+	};
+
+private:
+
+	static const uint64_t HashBasis = 14695981039346656037ull;
+
+	static ElementType ElementTypeOf(const uint8_t*) { return ElementType::Unorm8; }
+	static ElementType ElementTypeOf(const uint16_t*) { return ElementType::Half; }
+	static ElementType ElementTypeOf(const float*) { return ElementType::Float; }
+
+	VolumeFile(const VolumeFile&) = delete;
+	VolumeFile& operator=(const VolumeFile&) = delete;
+
+	const uint8_t* mData;
+	size_t mSize;
+#ifdef _WIN32
+	void* mFileHandle;
+	void* mMappingHandle;
+#endif
+};
+
+#endif // D_VOLUMEFILE
@@ -0,0 +1,182 @@
+
+#include "VolumeMips.h"
+
+#include <math.h>
+#include <algorithm>
+
+namespace
+{
+
+	const double Pi = 3.14159265358979323846;
+
+	double Sinc(double x)
+	{
+		return x == 0.0 ? 1.0 : sin(Pi * x) / (Pi * x);
+	}
+
+	// Modified Bessel function of the first kind of order 0, from its power series
+	double BesselI0(double x)
+	{
+		double sum = 1.0;
+		double term = 1.0;
+		for (int k = 1; k < 32; k++)
+		{
+			term *= (x * 0.5 / k) * (x * 0.5 / k);
+			sum += term;
+		}
+		return sum;
+	}
+
+	// Weights of the source voxels 2 * i + first .. 2 * i + first + weights.size() - 1 averaged into destination voxel i
+	struct Taps
+	{
+		int first;
+		std::vector<float> weights;
+
+		explicit Taps(VolumeMips::Filter filter)
+		{
+			if (filter == VolumeMips::Filter::Box)
+			{
+				first = 0;
+				weights.assign(2, 0.5f);
+				return;
+			}
+
+			// Source voxel centers are at -0.25, +0.25, ... destination voxels from the center of the destination voxel
+			const double radius = 3.0;
+			const int count = int(4.0 * radius);
+			first = 1 - count / 2;
+			std::vector<double> w(count);
+			double sum = 0.0;
+			for (int m = 0; m < count; m++)
+			{
+				const double x = (double(first + m) - 0.5) * 0.5;
+				const double t = x / radius;
+				const double window = filter == VolumeMips::Filter::Lanczos ? Sinc(t)
+					: BesselI0(4.0 * sqrt(std::max(0.0, 1.0 - t * t))) / BesselI0(4.0);
+				w[m] = Sinc(x) * window;
+				sum += w[m];
+			}
+			for (int m = 0; m < count; m++)
+				weights.push_back(float(w[m] / sum));
+		}
+
+		// Source index of each tap of each destination voxel, wrapped around the source size
+		std::vector<int> Indices(int size) const
+		{
+			const int tapCount = int(weights.size());
+			std::vector<int> indices(size_t(size / 2) * tapCount);
+			for (int i = 0; i < size / 2; i++)
+				for (int m = 0; m < tapCount; m++)
+					indices[i * tapCount + m] = ((2 * i + first + m) % size + size) % size;
+			return indices;
+		}
+	};
+
+}
+
+int VolumeMips::GetLevelCount(int size)
+{
+	int count = 0;
+	for (; size > 1 && size % 2 == 0; size /= 2)
+		count++;
+	return count;
+}
+
+std::string VolumeMips::GetLevelFileName(const std::string& fileName, int level)
+{
+	const size_t dot = fileName.find_last_of('.');
+	const size_t slash = fileName.find_last_of("/\\");
+	const size_t insert = dot != std::string::npos && (slash == std::string::npos || dot > slash) ? dot : fileName.size();
+	return fileName.substr(0, insert) + "_mip" + std::to_string(level) + fileName.substr(insert);
+}
+
+void VolumeMips::Downsample(TaskScheduler& scheduler, const float* src, int size, Filter filter, float* dst)
+{
+	const Taps taps(filter);
+	const int tapCount = int(taps.weights.size());
+	const float* weights = taps.weights.data();
+	const std::vector<int> indices = taps.Indices(size);
+	const size_t n = size_t(size);
+	const size_t h = n / 2;
+
+	// Along x: size^3 to h * size^2
+	std::vector<float> halfX(h * n * n);
+	scheduler.ParallelFor3d(Range3d(glm::ivec3(0), glm::ivec3(1, size, size)), glm::ivec3(1, size, 1), [&](const Range3d& block)
+	{
+		for (int r = block.begin.z; r < block.end.z; r++)
+			for (int t = 0; t < size; t++)
+			{
+				const float* row = src + (size_t(r) * n + t) * n;
+				float* out = &halfX[(size_t(r) * n + t) * h];
+				for (size_t i = 0; i < h; i++)
+				{
+					float sum = 0.0f;
+					for (int m = 0; m < tapCount; m++)
+						sum += weights[m] * row[indices[i * tapCount + m]];
+					out[i] = sum;
+				}
+			}
+	});
+
+	// Along y: h * size^2 to h^2 * size, whole rows at a time
+	std::vector<float> halfY(h * h * n);
+	scheduler.ParallelFor3d(Range3d(glm::ivec3(0), glm::ivec3(1, 1, size)), glm::ivec3(1, 1, 1), [&](const Range3d& block)
+	{
+		for (int r = block.begin.z; r < block.end.z; r++)
+			for (size_t j = 0; j < h; j++)
+			{
+				float* out = &halfY[(size_t(r) * h + j) * h];
+				for (size_t i = 0; i < h; i++)
+					out[i] = 0.0f;
+				for (int m = 0; m < tapCount; m++)
+				{
+					const float* row = &halfX[(size_t(r) * n + indices[j * tapCount + m]) * h];
+					for (size_t i = 0; i < h; i++)
+						out[i] += weights[m] * row[i];
+				}
+			}
+	});
+
+	// Along z: h^2 * size to h^3, whole slices at a time
+	scheduler.ParallelFor3d(Range3d(glm::ivec3(0), glm::ivec3(1, 1, int(h))), glm::ivec3(1, 1, 1), [&](const Range3d& block)
+	{
+		for (int k = block.begin.z; k < block.end.z; k++)
+		{
+			float* out = dst + size_t(k) * h * h;
+			for (size_t i = 0; i < h * h; i++)
+				out[i] = 0.0f;
+			for (int m = 0; m < tapCount; m++)
+			{
+				const float* slice = &halfY[size_t(indices[k * tapCount + m]) * h * h];
+				for (size_t i = 0; i < h * h; i++)
+					out[i] += weights[m] * slice[i];
+			}
+		}
+	});
+}
+
+void VolumeMips::GenerateChain(TaskScheduler& scheduler, const float* src, int size, Filter filter, std::vector<std::vector<float>>& levels)
+{
+	levels.resize(GetLevelCount(size));
+	for (size_t k = 0; k < levels.size(); k++, size /= 2)
+	{
+		const size_t h = size_t(size / 2);
+		levels[k].resize(h * h * h);
+		Downsample(scheduler, k == 0 ? src : levels[k - 1].data(), size, filter, levels[k].data());
+	}
+}
+
+size_t VolumeMips::GetChainMemorySize(int size, int channelCount)
+{
+	const size_t n = size_t(size);
+	size_t levelBytes = 0;
+	for (int k = 1; k <= GetLevelCount(size); k++)
+	{
+		const size_t h = n >> k;
+		levelBytes += h * h * h * sizeof(float);
+	}
+	// Downsample of the whole volume: halved along x then along x and y
+	const size_t temporaryBytes = (n * n * n / 2 + n * n * n / 4) * sizeof(float);
+	return (n * n * n * sizeof(float) + levelBytes) * channelCount + temporaryBytes;
+}
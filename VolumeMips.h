@@ -0,0 +1,44 @@
+#ifndef D_VOLUMEMIPS
+#define D_VOLUMEMIPS
+
+#include "TaskScheduler.h"
+
+#include <string>
+#include <vector>
+
+///
+/// Mip chains of tileable volumes: each level halves the previous one with a separable filter wrapping around the
+/// edges of the volume, so that every level still tiles. Levels are built one after the other from the whole previous
+/// level, not in a single pass over the volume.
+///
+class VolumeMips
+{
+public:
+
+	enum class Filter
+	{
+		Box,		///< Average of 2x2x2 voxels.
+		Kaiser,		///< Kaiser windowed sinc (alpha 4), radius of 3 voxels of the destination level (6 wide), 12 taps per axis.
+		Lanczos,	///< Lanczos 3 windowed sinc, same radius and taps as Kaiser.
+	};
+
+	/// @return the number of levels below a size^3 volume, halving its size while it is even.
+	static int GetLevelCount(int size);
+
+	/// @return fileName with _mip<level> inserted before its extension.
+	static std::string GetLevelFileName(const std::string& fileName, int level);
+
+	/// Halves a size^3 volume of one channel, x being the fastest varying index. The 3 passes along x, y then z are split
+	/// in slices run by scheduler.
+	/// @param dst (size / 2)^3 values.
+	static void Downsample(TaskScheduler& scheduler, const float* src, int size, Filter filter, float* dst);
+
+	/// Downsamples every level from the previous one, levels[k] receiving the (size >> (k + 1))^3 values of level k + 1.
+	static void GenerateChain(TaskScheduler& scheduler, const float* src, int size, Filter filter, std::vector<std::vector<float>>& levels);
+
+	/// @return the peak bytes of the chains of channelCount channels of a size^3 volume: the source channels, the levels
+	/// of all the channels and the temporaries of one Downsample.
+	static size_t GetChainMemorySize(int size, int channelCount);
+};
+
+#endif // D_VOLUMEMIPS
@@ -48,6 +48,12 @@
 
 #include <stdio.h>
 #include <malloc.h>
+#include <string.h>
+
+#if !defined(WORDS_BIGENDIAN) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define TGA_SSE2
+#endif
 
 #include "libtarga.h"
 
@@ -104,9 +110,7 @@ static uint32 TargaError;
 
 
 static int16 ttohs( int16 val );
-static int16 htots( int16 val );
 static int32 ttohl( int32 val );
-static int32 htotl( int32 val );
 
 
 static uint32 tga_get_pixel( FILE * tga, ubyte bytes_per_pix, 
@@ -533,19 +537,66 @@ void * tga_load( const char * filename,
 
 int tga_write_raw( const char * file, int width, int height, unsigned char * dat, unsigned int format ) {
 
-    FILE * tga;
+    void * tga = tga_write_raw_begin( file, width, height, format );
 
-    uint32 i, j;
+    if( tga == NULL ) {
+        return( 0 );
+    }
 
-    uint32 size = width * height;
+    if( !tga_write_raw_pixels( tga, width * height, dat, format ) ) {
+        tga_write_raw_end( tga );
+        return( 0 );
+    }
 
-    float red, green, blue, alpha;
+    return( tga_write_raw_end( tga ) );
+
+}
+
+
+
+static void * tga_write_begin( const char * file, int width, int height, unsigned int format, const char * id, int rle );
+
+
+
+void * tga_write_raw_begin( const char * file, int width, int height, unsigned int format ) {
+
+    return( tga_write_begin( file, width, height, format, "written with libtarga", 0 ) );
+
+}
+
+
+
+void * tga_write_raw_begin_id( const char * file, int width, int height, unsigned int format, const char * id ) {
+
+    return( tga_write_begin( file, width, height, format, id, 0 ) );
+
+}
+
+
+
+void * tga_write_rle_begin( const char * file, int width, int height, unsigned int format ) {
+
+    return( tga_write_begin( file, width, height, format, "written with libtarga", 1 ) );
+
+}
+
+
+
+void * tga_write_rle_begin_id( const char * file, int width, int height, unsigned int format, const char * id ) {
+
+    return( tga_write_begin( file, width, height, format, id, 1 ) );
 
-    char id[] = "written with libtarga";
-    ubyte idlen = 21;
+}
+
+
+
+static void * tga_write_begin( const char * file, int width, int height, unsigned int format, const char * id, int rle ) {
+
+    FILE * tga;
+
+    size_t id_size = strlen( id );
+    ubyte idlen = (ubyte)id_size;
     ubyte zeroes[5] = { 0, 0, 0, 0, 0 };
-    uint32 pixbuf;
-    ubyte one = 1;
     ubyte cmap_type = 0;
     ubyte img_type  = 2;  // 2 - uncompressed truecolor  10 - RLE truecolor
     uint16 xorigin  = 0;
@@ -564,18 +615,39 @@ int tga_write_raw( const char * file, int width, int height, unsigned char * dat
         img_desc = 8;
         break;
 
+    case TGA_TRUECOLOR_32_STRAIGHT:
+        pixdepth = 32;
+        img_desc = 8;
+        break;
+
+    case TGA_GRAYSCALE_8:
+        img_type = 3;  // 3 - uncompressed grayscale
+        img_desc = 0;
+        break;
+
     default:
         TargaError = TGA_ERR_BAD_FORMAT;
-        return( 0 );
+        return( NULL );
         break;
 
     }
 
+    // 10 - RLE truecolor  11 - RLE grayscale
+    if( rle ) {
+        img_type += 8;
+    }
+
+    // the dimensions and the image id length are stored on 16 and 8 bits
+    if( width <= 0 || height <= 0 || width > 0xFFFF || height > 0xFFFF || id_size > 0xFF ) {
+        TargaError = TGA_ERR_BAD_DIMENSIONS;
+        return( NULL );
+    }
+
     tga = fopen( file, "wb" );
 
     if( tga == NULL ) {
         TargaError = TGA_ERR_OPEN_FAILS;
-        return( 0 );
+        return( NULL );
     }
 
     // write id length
@@ -600,38 +672,87 @@ int tga_write_raw( const char * file, int width, int height, unsigned char * dat
 
 
     // write image id.
-    fwrite( &id, idlen, 1, tga );
+    fwrite( id, 1, idlen, tga );
+
+    return( tga );
+
+}
+
+
+
+/* pixels converted to the file layout per fwrite by tga_write_raw_pixels */
+#define TGA_WRITE_CHUNK    (1 << 16)
+
+/* straight RGBA to BGRA, 4 pixels at a time with SSE2 */
+static void tga_swizzle_rgba( ubyte * out, const unsigned char * dat, uint32 count ) {
+
+    uint32 i = 0;
+
+#ifdef TGA_SSE2
+    const __m128i green_alpha = _mm_set1_epi32( (int)0xFF00FF00 );
+    const __m128i low = _mm_set1_epi32( 0xFF );
+
+    for( ; i + 4 <= count; i += 4 ) {
+        __m128i pix = _mm_loadu_si128( (const __m128i *)(dat + i * 4) );
+        __m128i red_blue = _mm_or_si128( _mm_slli_epi32( _mm_and_si128( pix, low ), 16 ),
+                                         _mm_and_si128( _mm_srli_epi32( pix, 16 ), low ) );
+        _mm_storeu_si128( (__m128i *)(out + i * 4), _mm_or_si128( _mm_and_si128( pix, green_alpha ), red_blue ) );
+    }
+#endif
+
+    for( ; i < count; i++ ) {
+        out[i*4]   = dat[i*4+2];
+        out[i*4+1] = dat[i*4+1];
+        out[i*4+2] = dat[i*4];
+        out[i*4+3] = dat[i*4+3];
+    }
+
+}
+
+
+
+/* count pixels of dat in format converted to the layout of the file */
+static void tga_convert_pixels( ubyte * out, const unsigned char * dat, uint32 count, unsigned int format ) {
+
+    uint32 i;
+
+    float red, green, blue, alpha;
 
     // color correction -- data is in RGB, need BGR.
-    for( i = 0; i < size; i++ ) {
+    switch( format ) {
+
+    case TGA_GRAYSCALE_8:
 
-        pixbuf = 0;
-        for( j = 0; j < format; j++ ) {
-            pixbuf += dat[i*format+j] << (8 * j);
+        memcpy( out, dat, count );
+
+        break;
+
+    case TGA_TRUECOLOR_24:
+
+        for( i = 0; i < count; i++ ) {
+            out[i*3]   = dat[i*3+2];
+            out[i*3+1] = dat[i*3+1];
+            out[i*3+2] = dat[i*3];
         }
 
-        switch( format ) {
+        break;
 
-        case TGA_TRUECOLOR_24:
+    case TGA_TRUECOLOR_32_STRAIGHT:
 
-            pixbuf = ((pixbuf & 0xFF) << 16) + 
-                     (pixbuf & 0xFF00) + 
-                     ((pixbuf & 0xFF0000) >> 16);
+        tga_swizzle_rgba( out, dat, count );
 
-            pixbuf = htotl( pixbuf );
-            
-            fwrite( &pixbuf, 3, 1, tga );
+        break;
 
-            break;
+    case TGA_TRUECOLOR_32:
 
-        case TGA_TRUECOLOR_32:
+        for( i = 0; i < count; i++ ) {
 
             /* need to un-premultiply alpha.. */
 
-            red     = (pixbuf & 0xFF) / 255.0f;
-            green   = ((pixbuf & 0xFF00) >> 8) / 255.0f;
-            blue    = ((pixbuf & 0xFF0000) >> 16) / 255.0f;
-            alpha   = ((pixbuf & 0xFF000000) >> 24) / 255.0f;
+            red     = dat[i*4] / 255.0f;
+            green   = dat[i*4+1] / 255.0f;
+            blue    = dat[i*4+2] / 255.0f;
+            alpha   = dat[i*4+3] / 255.0f;
 
             if( alpha > 0.0001 ) {
                 red /= alpha;
@@ -646,374 +767,219 @@ int tga_write_raw( const char * file, int width, int height, unsigned char * dat
             blue = blue > 1.0f ? 255.0f : blue * 255.0f;
             alpha = alpha > 1.0f ? 255.0f : alpha * 255.0f;
 
-            pixbuf = (ubyte)blue + (((ubyte)green) << 8) + 
-                (((ubyte)red) << 16) + (((ubyte)alpha) << 24);
-                
-            pixbuf = htotl( pixbuf );
-           
-            fwrite( &pixbuf, 4, 1, tga );
-
-            break;
+            out[i*4]   = (ubyte)blue;
+            out[i*4+1] = (ubyte)green;
+            out[i*4+2] = (ubyte)red;
+            out[i*4+3] = (ubyte)alpha;
 
         }
 
-    }
-
-    fclose( tga );
+        break;
 
-    return( 1 );
+    }
 
 }
 
 
 
+static uint32 tga_bytes_per_pixel( unsigned int format ) {
 
+    switch( format ) {
+    case TGA_GRAYSCALE_8:
+        return( 1 );
+    case TGA_TRUECOLOR_24:
+        return( 3 );
+    case TGA_TRUECOLOR_32:
+    case TGA_TRUECOLOR_32_STRAIGHT:
+        return( 4 );
+    default:
+        TargaError = TGA_ERR_BAD_FORMAT;
+        return( 0 );
+    }
 
-int tga_write_rle( const char * file, int width, int height, unsigned char * dat, unsigned int format ) {
-
-    FILE * tga;
-
-    uint32 i, j;
-    uint32 oc, nc;
-
-    enum RLE_STATE { INIT, NONE, RLP, RAWP };
-
-    int state = INIT;
-
-    uint32 size = width * height;
+}
 
-    uint16 shortwidth = (uint16)width;
-    uint16 shortheight = (uint16)height;
 
-    ubyte repcount;
 
-    float red, green, blue, alpha;
+int tga_write_raw_pixels( void * file, int count, const unsigned char * dat, unsigned int format ) {
 
-    int idx, row, column;
+    FILE * tga = (FILE *)file;
 
-    // have to buffer a whole line for raw packets.
-    unsigned char * rawbuf = (unsigned char *)malloc( width * format );  
+    uint32 chunk, bytes;
 
-    char id[] = "written with libtarga";
-    ubyte idlen = 21;
-    ubyte zeroes[5] = { 0, 0, 0, 0, 0 };
-    uint32 pixbuf;
-    ubyte one = 1;
-    ubyte cmap_type = 0;
-    ubyte img_type  = 10;  // 2 - uncompressed truecolor  10 - RLE truecolor
-    uint16 xorigin  = 0;
-    uint16 yorigin  = 0;
-    ubyte  pixdepth = format * 8;  // bpp
-    ubyte img_desc  = format == TGA_TRUECOLOR_32 ? 8 : 0;
-  
+    ubyte * buf;
 
-    switch( format ) {
-    case TGA_TRUECOLOR_24:
-    case TGA_TRUECOLOR_32:
-        break;
+    // grayscale is written as is
+    if( format == TGA_GRAYSCALE_8 ) {
+        return( fwrite( dat, 1, count, tga ) == (size_t)count );
+    }
 
-    default:
-        TargaError = TGA_ERR_BAD_FORMAT;
+    bytes = tga_bytes_per_pixel( format );
+    if( bytes == 0 ) {
         return( 0 );
     }
 
-
-    tga = fopen( file, "wb" );
-
-    if( tga == NULL ) {
-        TargaError = TGA_ERR_OPEN_FAILS;
+    buf = (ubyte *)malloc( TGA_WRITE_CHUNK * bytes );
+    if( buf == NULL ) {
         return( 0 );
     }
 
-    // write id length
-    fwrite( &idlen, 1, 1, tga );
+    for( ; count > 0; count -= chunk, dat += chunk * bytes ) {
 
-    // write colormap type
-    fwrite( &cmap_type, 1, 1, tga );
+        chunk = count < TGA_WRITE_CHUNK ? count : TGA_WRITE_CHUNK;
 
-    // write image type
-    fwrite( &img_type, 1, 1, tga );
+        tga_convert_pixels( buf, dat, chunk, format );
 
-    // write cmap spec.
-    fwrite( &zeroes, 5, 1, tga );
-
-    // write image spec.
-    fwrite( &xorigin, 2, 1, tga );
-    fwrite( &yorigin, 2, 1, tga );
-    fwrite( &shortwidth, 2, 1, tga );
-    fwrite( &shortheight, 2, 1, tga );
-    fwrite( &pixdepth, 1, 1, tga );
-    fwrite( &img_desc, 1, 1, tga );
+        if( fwrite( buf, bytes, chunk, tga ) != chunk ) {
+            free( buf );
+            return( 0 );
+        }
 
+    }
 
-    // write image id.
-    fwrite( &id, idlen, 1, tga );
+    free( buf );
 
-    // initial color values -- just to shut up the compiler.
-    nc = 0;
+    return( 1 );
 
-    // color correction -- data is in RGB, need BGR.
-    // also run-length-encoding.
-    for( i = 0; i < size; i++ ) {
+}
 
-        idx = i * format;
 
-        row = i / width;
-        column = i % width;
 
-        //printf( "row: %d, col: %d\n", row, column );
-        pixbuf = 0;
-        for( j = 0; j < format; j++ ) {
-            pixbuf += dat[idx+j] << (8 * j);
-        }
+int tga_write_raw_end( void * file ) {
 
-        switch( format ) {
+    // buffered pixels are only written by fclose, which may still fail
+    return( fclose( (FILE *)file ) == 0 );
 
-        case TGA_TRUECOLOR_24:
+}
 
-            pixbuf = ((pixbuf & 0xFF) << 16) + 
-                     (pixbuf & 0xFF00) + 
-                     ((pixbuf & 0xFF0000) >> 16);
 
-            pixbuf = htotl( pixbuf );
-            break;
 
-        case TGA_TRUECOLOR_32:
 
-            /* need to un-premultiply alpha.. */
 
-            red     = (pixbuf & 0xFF) / 255.0f;
-            green   = ((pixbuf & 0xFF00) >> 8) / 255.0f;
-            blue    = ((pixbuf & 0xFF0000) >> 16) / 255.0f;
-            alpha   = ((pixbuf & 0xFF000000) >> 24) / 255.0f;
+int tga_write_rle( const char * file, int width, int height, unsigned char * dat, unsigned int format ) {
 
-            if( alpha > 0.0001 ) {
-                red /= alpha;
-                green /= alpha;
-                blue /= alpha;
-            }
+    void * tga = tga_write_rle_begin( file, width, height, format );
 
-            /* clamp to 1.0f */
+    uint32 bytes = tga_bytes_per_pixel( format );
 
-            red = red > 1.0f ? 255.0f : red * 255.0f;
-            green = green > 1.0f ? 255.0f : green * 255.0f;
-            blue = blue > 1.0f ? 255.0f : blue * 255.0f;
-            alpha = alpha > 1.0f ? 255.0f : alpha * 255.0f;
+    unsigned char * packets;
 
-            pixbuf = (ubyte)blue + (((ubyte)green) << 8) + 
-                (((ubyte)red) << 16) + (((ubyte)alpha) << 24);
-                
-            pixbuf = htotl( pixbuf );
-            break;
+    int row, size;
 
-        }
+    if( tga == NULL ) {
+        return( 0 );
+    }
 
+    // packets do not cross scanlines, so they are encoded row by row
+    packets = (unsigned char *)malloc( tga_rle_bound( width, format ) );
+    if( packets == NULL ) {
+        tga_write_raw_end( tga );
+        return( 0 );
+    }
 
-        oc = nc;
+    for( row = 0; row < height; row++ ) {
+        size = tga_rle_encode( width, dat + (size_t)row * width * bytes, format, packets );
+        if( size == 0 || !tga_write_rle_packets( tga, size, packets ) ) {
+            free( packets );
+            tga_write_raw_end( tga );
+            return( 0 );
+        }
+    }
 
-        nc = pixbuf;
+    free( packets );
 
+    return( tga_write_raw_end( tga ) );
 
-        switch( state ) {
+}
 
-        case INIT:
-            // this is just used to make sure we have 2 pixel values to consider.
-            state = NONE;
-            break;
 
 
-        case NONE:
+int tga_rle_bound( int count, unsigned int format ) {
 
-            if( column == 0 ) {
-                // write a 1 pixel raw packet for the old pixel, then go thru again.
-                repcount = 0;
-                fwrite( &repcount, 1, 1, tga );
-#ifdef WORDS_BIGENDIAN
-                fwrite( (&oc)+4, format, 1, tga );  // byte order..
-#else
-                fwrite( &oc, format, 1, tga );
-#endif
-                state = NONE;
-                break;
-            }
+    // all raw packets, each one holding up to 128 pixels after its header byte
+    return( count * tga_bytes_per_pixel( format ) + (count + 127) / 128 );
 
-            if( nc == oc ) {
-                repcount = 0;
-                state = RLP;
-            } else {
-                repcount = 0;
-                state = RAWP;
-                for( j = 0; j < format; j++ ) {
-#ifdef WORDS_BIGENDIAN
-                    rawbuf[(repcount * format) + j] = (ubyte)(*((&oc)+format-j-1));
-#else
-                    rawbuf[(repcount * format) + j] = *(((ubyte *)(&oc)) + j);
-#endif
-                }
-            }
-            break;
+}
 
 
-        case RLP:
-            repcount++;
 
-            if( column == 0 ) {
-                // finish off rlp.
-                repcount |= 0x80;
-                fwrite( &repcount, 1, 1, tga );
-#ifdef WORDS_BIGENDIAN
-                fwrite( (&oc)+4, format, 1, tga );  // byte order..
-#else
-                fwrite( &oc, format, 1, tga );
-#endif
-                state = NONE;
-                break;
-            }
+static int tga_same_pixel( const ubyte * a, const ubyte * b, uint32 bytes ) {
 
-            if( repcount == 127 ) {
-                // finish off rlp.
-                repcount |= 0x80;
-                fwrite( &repcount, 1, 1, tga );
-#ifdef WORDS_BIGENDIAN
-                fwrite( (&oc)+4, format, 1, tga );  // byte order..
-#else
-                fwrite( &oc, format, 1, tga );
-#endif
-                state = NONE;
-                break;
-            }
+    switch( bytes ) {
+    case 1:
+        return( a[0] == b[0] );
+    case 4:
+        return( a[0] == b[0] && a[1] == b[1] && a[2] == b[2] && a[3] == b[3] );
+    default:
+        return( memcmp( a, b, bytes ) == 0 );
+    }
 
-            if( nc != oc ) {
-                // finish off rlp
-                repcount |= 0x80;
-                fwrite( &repcount, 1, 1, tga );
-#ifdef WORDS_BIGENDIAN
-                fwrite( (&oc)+4, format, 1, tga );  // byte order..
-#else
-                fwrite( &oc, format, 1, tga );
-#endif
-                state = NONE;
-            }
-            break;
+}
 
 
-        case RAWP:
-            repcount++;
 
-            if( column == 0 ) {
-                // finish off rawp.
-                for( j = 0; j < format; j++ ) {
-#ifdef WORDS_BIGENDIAN
-                    rawbuf[(repcount * format) + j] = (ubyte)(*((&oc)+format-j-1));
-#else
-                    rawbuf[(repcount * format) + j] = *(((ubyte *)(&oc)) + j);
-#endif
-                }
-                fwrite( &repcount, 1, 1, tga );
-                fwrite( rawbuf, (repcount + 1) * format, 1, tga );
-                state = NONE;
-                break;
-            }
+int tga_rle_encode( int count, const unsigned char * dat, unsigned int format, unsigned char * out ) {
 
-            if( repcount == 127 ) {
-                // finish off rawp.
-                for( j = 0; j < format; j++ ) {
-#ifdef WORDS_BIGENDIAN
-                    rawbuf[(repcount * format) + j] = (ubyte)(*((&oc)+format-j-1));
-#else
-                    rawbuf[(repcount * format) + j] = *(((ubyte *)(&oc)) + j);
-#endif
-                }
-                fwrite( &repcount, 1, 1, tga );
-                fwrite( rawbuf, (repcount + 1) * format, 1, tga );
-                state = NONE;
-                break;
-            }
+    uint32 bytes = tga_bytes_per_pixel( format );
 
-            if( nc == oc ) {
-                // finish off rawp
-                repcount--;
-                fwrite( &repcount, 1, 1, tga );
-                fwrite( rawbuf, (repcount + 1) * format, 1, tga );
-                
-                // start new rlp
-                repcount = 0;
-                state = RLP;
-                break;
-            }
+    uint32 i, n, k;
 
-            // continue making rawp
-            for( j = 0; j < format; j++ ) {
-#ifdef WORDS_BIGENDIAN
-                rawbuf[(repcount * format) + j] = (ubyte)(*((&oc)+format-j-1));
-#else
-                rawbuf[(repcount * format) + j] = *(((ubyte *)(&oc)) + j);
-#endif
-            }
+    // shorter runs of 1 byte pixels are as large as raw and could exceed tga_rle_bound after a raw packet
+    uint32 min_run = bytes == 1 ? 3 : 2;
 
-            break;
+    ubyte * pix;
 
-        }
-       
+    unsigned char * packet = out;
 
+    if( bytes == 0 || count <= 0 ) {
+        return( 0 );
     }
 
+    pix = (ubyte *)malloc( (size_t)count * bytes );
+    if( pix == NULL ) {
+        return( 0 );
+    }
 
-    // clean up state.
-
-    switch( state ) {
+    // packets compare the pixels as written, premultiplied colors may only become equal once converted
+    tga_convert_pixels( pix, dat, count, format );
 
-    case INIT:
-        break;
+    for( i = 0; i < (uint32)count; i += n ) {
 
-    case NONE:
-        // write the last 2 pixels in a raw packet.
-        fwrite( &one, 1, 1, tga );
-#ifdef WORDS_BIGENDIAN
-                fwrite( (&oc)+4, format, 1, tga );  // byte order..
-#else
-                fwrite( &oc, format, 1, tga );
-#endif
-#ifdef WORDS_BIGENDIAN
-                fwrite( (&nc)+4, format, 1, tga );  // byte order..
-#else
-                fwrite( &nc, format, 1, tga );
-#endif
-        break;
+        // run length packet for min_run to 128 identical pixels
+        for( n = 1; i + n < (uint32)count && n < 128 && tga_same_pixel( pix + i * bytes, pix + (i + n) * bytes, bytes ); n++ );
 
-    case RLP:
-        repcount++;
-        repcount |= 0x80;
-        fwrite( &repcount, 1, 1, tga );
-#ifdef WORDS_BIGENDIAN
-                fwrite( (&oc)+4, format, 1, tga );  // byte order..
-#else
-                fwrite( &oc, format, 1, tga );
-#endif
-        break;
+        if( n >= min_run ) {
+            *packet++ = (unsigned char)(0x80 | (n - 1));
+            memcpy( packet, pix + i * bytes, bytes );
+            packet += bytes;
+            continue;
+        }
 
-    case RAWP:
-        repcount++;
-        for( j = 0; j < format; j++ ) {
-#ifdef WORDS_BIGENDIAN
-            rawbuf[(repcount * format) + j] = (ubyte)(*((&oc)+format-j-1));
-#else
-            rawbuf[(repcount * format) + j] = *(((ubyte *)(&oc)) + j);
-#endif
+        // else raw packet up to the next run
+        for( n = 1; i + n < (uint32)count && n < 128; n++ ) {
+            for( k = 1; k < min_run && i + n + k < (uint32)count && tga_same_pixel( pix + (i + n) * bytes, pix + (i + n + k) * bytes, bytes ); k++ );
+            if( k == min_run ) {
+                break;
+            }
         }
-        fwrite( &repcount, 1, 1, tga );
-        fwrite( rawbuf, (repcount + 1) * 3, 1, tga );
-        break;
+
+        *packet++ = (unsigned char)(n - 1);
+        memcpy( packet, pix + i * bytes, n * bytes );
+        packet += n * bytes;
 
     }
 
+    free( pix );
 
-    // close the file.
-    fclose( tga );
+    return( (int)(packet - out) );
 
-    free( rawbuf );
+}
 
-    return( 1 );
+
+
+int tga_write_rle_packets( void * tga, int size, const unsigned char * packets ) {
+
+    return( fwrite( packets, 1, size, (FILE *)tga ) == (size_t)size );
 
 }
 
@@ -1222,17 +1188,6 @@ static int16 ttohs( int16 val ) {
 }
 
 
-static int16 htots( int16 val ) {
-
-#ifdef WORDS_BIGENDIAN
-    return( ((val & 0xFF) << 8) + (val >> 8) );
-#else
-    return( val );
-#endif
-
-}
-
-
 static int32 ttohl( int32 val ) {
 
 #ifdef WORDS_BIGENDIAN
@@ -1247,15 +1202,4 @@ static int32 ttohl( int32 val ) {
 }
 
 
-static int32 htotl( int32 val ) {
 
-#ifdef WORDS_BIGENDIAN
-    return( ((val & 0x000000FF) << 24) +
-            ((val & 0x0000FF00) << 8)  +
-            ((val & 0x00FF0000) >> 8)  +
-            ((val & 0xFF000000) >> 24) );
-#else
-    return( val );
-#endif 
-
-}
@@ -43,14 +43,15 @@
 /* #define WORDS_BIGENDIAN */
 
 
-/* make sure these types reflect your system's type sizes. */
-#define byte    char
-#define int32   int
-#define int16   short
+/* make sure these types reflect your system's type sizes. typedefs rather than macros so
+   that they cannot rewrite std::byte or other names of the headers included after this one. */
+typedef char            byte;
+typedef int             int32;
+typedef short           int16;
 
-#define ubyte   unsigned byte
-#define uint32  unsigned int32
-#define uint16  unsigned int16
+typedef unsigned char   ubyte;
+typedef unsigned int    uint32;
+typedef unsigned short  uint16;
 
 
 
@@ -90,12 +91,21 @@
    For write, format is what format the data you're writing
    is in. (NOT the format you want written)
 
-   Only TGA_TRUECOLOR_32 supports an alpha channel.
+   Only TGA_TRUECOLOR_32 supports an alpha channel. Its color channels
+   are premultiplied by alpha and written divided by alpha.
+
+   TGA_TRUECOLOR_32_STRAIGHT is RGBA with straight (not premultiplied)
+   alpha, written as is. It is only supported by the writing functions.
+
+   TGA_GRAYSCALE_8 is only supported by the writing functions, it writes
+   8 bit grayscale images.
 
 */
 
 #define TGA_TRUECOLOR_32      (4)
 #define TGA_TRUECOLOR_24      (3)
+#define TGA_TRUECOLOR_32_STRAIGHT (5)
+#define TGA_GRAYSCALE_8       (1)
 
 
 /*
@@ -123,6 +133,27 @@ void * tga_load( const char * file, int * width, int * height, unsigned int form
 int tga_write_raw( const char * file, int width, int height, unsigned char * dat, unsigned int format );
 int tga_write_rle( const char * file, int width, int height, unsigned char * dat, unsigned int format );
 
+/* Writing uncompressed images progressively: tga_write_raw_begin writes the header and returns NULL on error, then the
+   width * height pixels are passed in order over any number of tga_write_raw_pixels calls, then tga_write_raw_end
+   closes the file. The bytes written are the same as tga_write_raw. Pixels are converted to the file layout by large
+   chunks, each written with a single fwrite. */
+void * tga_write_raw_begin( const char * file, int width, int height, unsigned int format );
+/* Same as tga_write_raw_begin with id, at most 255 characters, in the image id field instead of "written with libtarga". */
+void * tga_write_raw_begin_id( const char * file, int width, int height, unsigned int format, const char * id );
+int tga_write_raw_pixels( void * tga, int count, const unsigned char * dat, unsigned int format );
+int tga_write_raw_end( void * tga );
+
+/* Writing RLE compressed images progressively: tga_write_rle_begin writes the header, then the packets of the
+   scanlines are appended in order by tga_write_rle_packets, and tga_write_raw_end closes the file. tga_rle_encode
+   converts count pixels of a single scanline (packets may not cross scanlines) to at most tga_rle_bound bytes of
+   packets and returns their size, 0 on error. It has no side effect besides the error code, so scanlines can be
+   encoded concurrently into separate buffers. */
+void * tga_write_rle_begin( const char * file, int width, int height, unsigned int format );
+void * tga_write_rle_begin_id( const char * file, int width, int height, unsigned int format, const char * id );
+int tga_rle_bound( int count, unsigned int format );
+int tga_rle_encode( int count, const unsigned char * dat, unsigned int format, unsigned char * out );
+int tga_write_rle_packets( void * tga, int size, const unsigned char * packets );
+
 
 
 #ifdef __cplusplus
@@ -3,30 +3,442 @@
 #include <iostream>
 #include <time.h>
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
 
 #include "./TileableVolumeNoise.h"
+#include "./TaskScheduler.h"
+#include "./NoiseChannelGraph.h"
+#include "./ExrWriter.h"
+#include "./VolumeMips.h"
+#include "./VolumeFile.h"
+#include "./VolumeArchive.h"
 #include "./libtarga.h"
 
-#include <ppl.h>
-using namespace concurrency;
-
 void writeTGA(const char* fileName, int width, int height, /*const*/ unsigned char* data)
 {
 	if (!tga_write_raw(fileName, width, height, data, TGA_TRUECOLOR_32))
 	{
 		printf("Failed to write image!\n");
-		printf(tga_error_string(tga_get_last_error()));
+		printf("%s\n", tga_error_string(tga_get_last_error()));
 	}
 }
 
-// the remap function used in the shaders as described in Gpu Pro 7. It must match when using pre packed textures
-float remap(float originalValue, float originalMin, float originalMax, float newMin, float newMax)
+// Cloud shape and erosion volumes similarly to GPU Pro 7 chapter II-4, see NoiseChannelGraph.h for the syntax.
+// Another description can be loaded with -channels <file>. Outputs are tagged raw or packed for -outputs.
+const char* defaultChannels = R"(
+# Cloud base shape (will be used to generate PerlinWorley noise in the shader)
+# !!! If size is reduced, the number of frequencies of the Worley FBM should be reduced too !!!
+volume shape 128
+perlin = perlin 8 3
+
+# Perlin Worley is based on description in GPU Pro 7: Real Time Volumetric Cloudscapes, Worley FBM at 4 cells times 2, 8 and 14.
+# However it is not clear the text and the image are matching: images does not seem to match what the result from the description in text would give.
+# Also there are a lot of fudge factor in the code, e.g. *0.2, so it is really up to you to find the formula you like.
+perlinWorley0 = worley 8
+perlinWorley1 = worley 32
+perlinWorley2 = worley 56
+perlinWorleyFBM = fbm perlinWorley0 0.625 perlinWorley1 0.25 perlinWorley2 0.125
+# Mapping perlin noise in between worley as minimum and 1.0 as maximum (as described in text of p.101 of GPU Pro 7).
+# Matching better figure 4.7 would be: remap perlinWorleyFBM 0 1 0 perlin
+perlinWorley = remap perlin 0 1 perlinWorleyFBM 1
+
+# Three frequencies of Worley FBM noise
+worley1 = worley 8
+worley2 = worley 16
+worley3 = worley 32
+worley4 = worley 64
+worleyFBM0 = fbm worley1 0.625 worley2 0.25 worley3 0.125
+worleyFBM1 = fbm worley2 0.625 worley3 0.25 worley4 0.125
+# cellCount=4 -> worley 128 is just noise due to sampling frequency=texel frequency. So only take into account 2 frequencies for FBM
+worleyFBM2 = fbm worley3 0.75 worley4 0.25
+
+# Channels packed for direct usage in shader
+lowFreqFBM = fbm worleyFBM0 0.625 worleyFBM1 0.25 worleyFBM2 0.125
+lowFreqFBMMinusOne = sub lowFreqFBM 1
+packed = remap perlinWorley lowFreqFBMMinusOne 1 0 1
+packedSaturated = saturate packed
+
+output noiseShape.tga perlinWorley worleyFBM0 worleyFBM1 worleyFBM2 raw
+output noiseShapePacked.tga packedSaturated packedSaturated packedSaturated 1 packed
+
+# Detail texture being different frequencies of Worley noise
+volume erosion 32
+worley0 = worley 2
+worley1 = worley 4
+worley2 = worley 8
+worley3 = worley 16
+# 3 octaves
+worleyFBM0 = fbm worley0 0.625 worley1 0.25 worley2 0.125
+worleyFBM1 = fbm worley1 0.625 worley2 0.25 worley3 0.125
+# cellCount=4 -> worley 32 is just noise due to sampling frequency=texel frequency. So only take into account 2 frequencies for FBM
+worleyFBM2 = fbm worley2 0.75 worley3 0.25
+# 2 octaves alternative:
+# worley0 = worley 4
+# worley1 = worley 7
+# worley2 = worley 10
+# worley3 = worley 13
+# worleyFBM0 = fbm worley0 0.75 worley1 0.25
+# worleyFBM1 = fbm worley1 0.75 worley2 0.25
+# worleyFBM2 = fbm worley2 0.75 worley3 0.25
+
+packed = fbm worleyFBM0 0.625 worleyFBM1 0.25 worleyFBM2 0.125
+
+output noiseErosion.tga worleyFBM0 worleyFBM1 worleyFBM2 1 raw
+output noiseErosionPacked.tga packed packed packed 1 packed
+)";
+
+// Write bandwidth of the volume generation loops on a size^3 pair of RGBA8 volumes, comparing one x index per task
+// with z innermost (the former order) against one z slice per task with x innermost.
+// Noise is replaced by a cheap function of the coordinates so that only the memory access pattern is measured.
+void benchmarkVolumeLayout(TaskScheduler& scheduler, int size)
 {
-	return newMin + (((originalValue - originalMin) / (originalMax - originalMin)) * (newMax - newMin));
+	const size_t volumeBytes = size_t(size) * size * size * 4;
+	unsigned char* texels = (unsigned char*)malloc(volumeBytes);
+	unsigned char* texelsPacked = (unsigned char*)malloc(volumeBytes);
+	auto writeVoxel = [&](int s, int t, int r)
+	{
+		const size_t addr = (size_t(r)*size*size + t*size + s) * 4;
+		texels[addr] = (unsigned char)(s);
+		texels[addr + 1] = (unsigned char)(t);
+		texels[addr + 2] = (unsigned char)(r);
+		texels[addr + 3] = (unsigned char)(s ^ t ^ r);
+		texelsPacked[addr] = (unsigned char)(s + t + r);
+		texelsPacked[addr + 1] = (unsigned char)(s + t + r);
+		texelsPacked[addr + 2] = (unsigned char)(s + t + r);
+		texelsPacked[addr + 3] = (unsigned char)(255);
+	};
+
+	const Range3d range(glm::ivec3(0), glm::ivec3(size));
+	auto run = [&](const char* label, const glm::ivec3& blockSize, bool xInnermost)
+	{
+		const int iterationCount = 20;
+		double bestMs = 1.0e30;
+		for (int i = 0; i < iterationCount; i++)
+		{
+			const TaskTimings timings = scheduler.ParallelFor3d(range, blockSize, [&](const Range3d& block)
+			{
+				if (xInnermost)
+				{
+					for (int r = block.begin.z; r < block.end.z; r++)
+						for (int t = block.begin.y; t < block.end.y; t++)
+							for (int s = block.begin.x; s < block.end.x; s++)
+								writeVoxel(s, t, r);
+				}
+				else
+				{
+					for (int s = block.begin.x; s < block.end.x; s++)
+						for (int t = block.begin.y; t < block.end.y; t++)
+							for (int r = block.begin.z; r < block.end.z; r++)
+								writeVoxel(s, t, r);
+				}
+			});
+			bestMs = std::min(bestMs, timings.wallMs);
+		}
+		printf("%s: %.3f ms, %.2f GB/s\n", label, bestMs, 2.0 * volumeBytes / (bestMs * 1.0e6));
+	};
+	printf("Volume layout benchmark, %d^3 RGBA8 x2 on %d threads\n", size, scheduler.GetThreadCount());
+	run("  x per task, z innermost ", glm::ivec3(1, size, size), false);
+	run("  z per task, x innermost ", glm::ivec3(size, size, 1), true);
+
+	free(texels);
+	free(texelsPacked);
+}
+
+// Appends the comma separated tags of list to tags
+void splitTags(const char* list, std::vector<std::string>& tags)
+{
+	for (const char* tag = list; *tag; )
+	{
+		const char* end = strchr(tag, ',');
+		if (!end)
+			end = tag + strlen(tag);
+		tags.push_back(std::string(tag, end));
+		tag = *end ? end + 1 : end;
+	}
 }
 
 int main (int argc, char *argv[])
 {   
+	int threadCount = 0;
+	bool printTimings = false;
+	bool benchmarkLayout = false;
+	const char* infoFileName = nullptr;
+	bool nativePerlin = false;
+	int seed = 0;
+	const char* channelsFileName = nullptr;
+	NoiseChannelGraph::TaskSplit taskSplit = NoiseChannelGraph::TaskSplit::Slices;
+	size_t memoryBudget = 0;
+	std::vector<std::string> outputTags;
+	std::vector<std::string> singleChannelTags;
+	NoiseChannelGraph::Quantization quantization = NoiseChannelGraph::Quantization::Truncate;
+	unsigned int rgbaFormat = TGA_TRUECOLOR_32;
+	bool atlasLayout = false;
+	bool rleTga = false;
+	int archiveBrickSize = 32;
+	VolumeArchive::Filter archiveFilter = VolumeArchive::Filter::Delta;
+	bool noiseMips = false;
+	bool filterMips = false;
+	VolumeMips::Filter mipFilter = VolumeMips::Filter::Box;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+		{
+			// Number of threads generating the volumes, all hardware threads by default
+			threadCount = atoi(argv[++i]);
+		}
+		if (strcmp(argv[i], "-timings") == 0)
+		{
+			printTimings = true;
+		}
+		if (strcmp(argv[i], "-benchmark-layout") == 0)
+		{
+			benchmarkLayout = true;
+		}
+		if (strcmp(argv[i], "-info") == 0 && i + 1 < argc)
+		{
+			infoFileName = argv[++i];
+		}
+		if (strcmp(argv[i], "-backend") == 0 && i + 1 < argc)
+		{
+			// Force the instruction set used by the noise kernels, e.g. "-backend avx2"
+			Tileable3dNoise::Backend backend;
+			if (!Tileable3dNoise::ParseBackendName(argv[++i], backend))
+			{
+				printf("Unknown backend %s, expected scalar, sse41, avx2 or avx512\n", argv[i]);
+				return 1;
+			}
+			Tileable3dNoise::SetBackend(backend);
+		}
+		if (strcmp(argv[i], "-hash") == 0 && i + 1 < argc)
+		{
+			// Hash placing the Worley feature points: "sin" (default, original textures) or "integer" (reproducible everywhere)
+			i++;
+			if (strcmp(argv[i], "integer") == 0)
+				Tileable3dNoise::SetHash(Tileable3dNoise::Hash::Integer);
+			else if (strcmp(argv[i], "sin") != 0)
+			{
+				printf("Unknown hash %s, expected sin or integer\n", argv[i]);
+				return 1;
+			}
+		}
+		if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+		{
+			// Seed of all the noises, 0 gives the original volumes
+			seed = atoi(argv[++i]);
+		}
+		if (strcmp(argv[i], "-perlin") == 0 && i + 1 < argc)
+		{
+			// Perlin noise of the cloud shape: "glm4d" (PerlinNoise, default) or "native3d" (PerlinNoise3d)
+			i++;
+			if (strcmp(argv[i], "native3d") == 0)
+				nativePerlin = true;
+			else if (strcmp(argv[i], "glm4d") != 0)
+			{
+				printf("Unknown Perlin noise %s, expected glm4d or native3d\n", argv[i]);
+				return 1;
+			}
+		}
+		if (strcmp(argv[i], "-quantize") == 0 && i + 1 < argc)
+		{
+			// Conversion of the 8 bit channels: "truncate" (default, the original textures), "round" or "dither"
+			i++;
+			if (strcmp(argv[i], "round") == 0)
+				quantization = NoiseChannelGraph::Quantization::Round;
+			else if (strcmp(argv[i], "dither") == 0)
+				quantization = NoiseChannelGraph::Quantization::Dither;
+			else if (strcmp(argv[i], "truncate") != 0)
+			{
+				printf("Unknown quantization %s, expected truncate, round or dither\n", argv[i]);
+				return 1;
+			}
+		}
+		if (strcmp(argv[i], "-alpha") == 0 && i + 1 < argc)
+		{
+			// The channels are independent noises, "straight" writes them as is instead of divided by alpha like the original TGA files
+			i++;
+			if (strcmp(argv[i], "straight") == 0)
+				rgbaFormat = TGA_TRUECOLOR_32_STRAIGHT;
+			else if (strcmp(argv[i], "premultiplied") != 0)
+			{
+				printf("Unknown alpha %s, expected straight or premultiplied\n", argv[i]);
+				return 1;
+			}
+		}
+		if (strcmp(argv[i], "-layout") == 0 && i + 1 < argc)
+		{
+			i++;
+			if (strcmp(argv[i], "atlas") == 0)
+				atlasLayout = true;
+			else if (strcmp(argv[i], "strip") != 0)
+			{
+				printf("Unknown layout %s, expected strip or atlas\n", argv[i]);
+				return 1;
+			}
+		}
+		if (strcmp(argv[i], "-compression") == 0 && i + 1 < argc)
+		{
+			i++;
+			if (strcmp(argv[i], "rle") == 0)
+				rleTga = true;
+			else if (strcmp(argv[i], "none") != 0)
+			{
+				printf("Unknown compression %s, expected none or rle\n", argv[i]);
+				return 1;
+			}
+		}
+		if (strcmp(argv[i], "-archive-brick") == 0 && i + 1 < argc)
+		{
+			archiveBrickSize = std::max(1, atoi(argv[++i]));
+		}
+		if (strcmp(argv[i], "-archive-filter") == 0 && i + 1 < argc)
+		{
+			i++;
+			if (strcmp(argv[i], "none") == 0)
+				archiveFilter = VolumeArchive::Filter::None;
+			else if (strcmp(argv[i], "delta") != 0)
+			{
+				printf("Unknown archive filter %s, expected none or delta\n", argv[i]);
+				return 1;
+			}
+		}
+		if (strcmp(argv[i], "-mips") == 0 && i + 1 < argc)
+		{
+			// Mip chain of every output: downsampled with a "box", "kaiser" or "lanczos" filter, or "noise" evaluated
+			// at the resolution of each level without the frequencies above its Nyquist limit
+			i++;
+			filterMips = true;
+			if (strcmp(argv[i], "box") == 0)
+				mipFilter = VolumeMips::Filter::Box;
+			else if (strcmp(argv[i], "kaiser") == 0)
+				mipFilter = VolumeMips::Filter::Kaiser;
+			else if (strcmp(argv[i], "lanczos") == 0)
+				mipFilter = VolumeMips::Filter::Lanczos;
+			else if (strcmp(argv[i], "noise") == 0)
+			{
+				filterMips = false;
+				noiseMips = true;
+			}
+			else
+			{
+				printf("Unknown mips %s, expected box, kaiser, lanczos or noise\n", argv[i]);
+				return 1;
+			}
+		}
+		if (strcmp(argv[i], "-channels") == 0 && i + 1 < argc)
+		{
+			// Description of the volumes and their channels replacing the default one, see NoiseChannelGraph.h
+			channelsFileName = argv[++i];
+		}
+		if (strcmp(argv[i], "-tasks") == 0 && i + 1 < argc)
+		{
+			// Split of the volumes into tasks: "slices" (default) or "bricks" (brick x noise tasks, for small volumes on many cores)
+			i++;
+			if (strcmp(argv[i], "bricks") == 0)
+				taskSplit = NoiseChannelGraph::TaskSplit::Bricks;
+			else if (strcmp(argv[i], "slices") != 0)
+			{
+				printf("Unknown task split %s, expected slices or bricks\n", argv[i]);
+				return 1;
+			}
+		}
+		if (strcmp(argv[i], "-memory-budget") == 0 && i + 1 < argc)
+		{
+			// MiB of texels kept in memory, the volumes being generated and written by windows of z slices fitting in it
+			memoryBudget = size_t(atof(argv[++i]) * 1024.0 * 1024.0);
+		}
+		if (strcmp(argv[i], "-outputs") == 0 && i + 1 < argc)
+		{
+			// Comma separated tags of the outputs to generate, the others and the channels only they use are skipped
+			outputTags.clear();
+			i++;
+			if (strcmp(argv[i], "all") == 0)
+				continue;
+			if (strcmp(argv[i], "both") == 0)
+			{
+				outputTags.push_back("raw");
+				outputTags.push_back("packed");
+				continue;
+			}
+			splitTags(argv[i], outputTags);
+		}
+		if (strcmp(argv[i], "-single-channel") == 0 && i + 1 < argc)
+		{
+			// Comma separated tags of the outputs written with their first channel only, e.g. "packed" for R8 packed volumes
+			singleChannelTags.clear();
+			splitTags(argv[++i], singleChannelTags);
+		}
+	}
+	printf("Noise backend: %s\n", Tileable3dNoise::GetBackendName(Tileable3dNoise::GetBackend()));
+
+	TaskScheduler scheduler(threadCount);
+
+	if (benchmarkLayout)
+	{
+		benchmarkVolumeLayout(scheduler, 128);
+		return 0;
+	}
+
+	const size_t infoLength = infoFileName ? strlen(infoFileName) : 0;
+	if (infoLength >= 5 && strcmp(infoFileName + infoLength - 5, ".varc") == 0)
+	{
+		// Header of an archive, then all its bricks decompressed in parallel to verify the hash
+		VolumeArchive::Reader archive;
+		std::string error;
+		if (!archive.Open(infoFileName, error))
+		{
+			printf("%s\n", error.c_str());
+			return 1;
+		}
+		const VolumeArchive::Header& header = archive.GetHeader();
+		const char* const elementTypeNames[] = { "", "unorm8", "half", "float" };
+		uint64_t compressedSize = 0;
+		uint64_t size = 0;
+		for (uint32_t z = 0; z < header.brickCounts[2]; z++)
+			for (uint32_t y = 0; y < header.brickCounts[1]; y++)
+				for (uint32_t x = 0; x < header.brickCounts[0]; x++)
+				{
+					compressedSize += archive.GetIndexEntry(x, y, z).compressedSize;
+					size += archive.GetIndexEntry(x, y, z).size;
+				}
+		printf("%s: version %u, %ux%ux%u %s %s, %u^3 bricks%s, %.1f%% of %llu bytes, parameters: %s\n", infoFileName, header.version,
+			header.width, header.height, header.depth, header.channels, elementTypeNames[int(header.elementType)], header.brickSize,
+			header.filter == VolumeArchive::Filter::Delta ? " delta filtered" : "", 100.0 * double(compressedSize) / double(size),
+			(unsigned long long)size, header.parameters);
+		std::vector<uint8_t> texels;
+		const auto start = std::chrono::steady_clock::now();
+		const bool decompressed = archive.ReadVolume(scheduler, texels);
+		const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		const bool hashMatches = decompressed && VolumeFile::Hash(texels.data(), texels.size()) == header.volumeHash;
+		printf("Read in %.2f ms, hash %016llx %s\n", ms, (unsigned long long)header.volumeHash,
+			!decompressed ? "not checked, corrupted brick" : hashMatches ? "verified" : "does NOT match the texels");
+		return hashMatches ? 0 : 1;
+	}
+	if (infoFileName)
+	{
+		// Header of a volume file, mapped without reading the texels until the hash is verified
+		VolumeFile volumeFile;
+		std::string error;
+		if (!volumeFile.Open(infoFileName, error))
+		{
+			printf("%s\n", error.c_str());
+			return 1;
+		}
+		const VolumeFile::Header& header = volumeFile.GetHeader();
+		const char* const elementTypeNames[] = { "", "unorm8", "half", "float" };
+		printf("%s: version %u, %ux%ux%u %s %s, parameters: %s\n", infoFileName, header.version, header.width, header.height, header.depth,
+			header.channels, elementTypeNames[int(header.elementType)], header.parameters);
+		const bool hashMatches = volumeFile.VerifyHash();
+		printf("Hash %016llx %s\n", (unsigned long long)header.payloadHash, hashMatches ? "verified" : "does NOT match the texels");
+		return hashMatches ? 0 : 1;
+	}
+
 	//
 	// Exemple of tileable Perlin noise texture generation
 	//
@@ -37,8 +449,9 @@ int main (int argc, char *argv[])
 
 	// Generate Perlin noise source
 	const glm::vec3 normFactPerlin = glm::vec3(1.0f / float(gPerlinNoiseTextureSize));
-	parallel_for(int(0), int(gPerlinNoiseTextureSize), [&](int s) //for (int s=0; s<giPerlinNoiseTextureSize; s++)
+	scheduler.ParallelFor3d(Range3d(glm::ivec3(0), glm::ivec3(gPerlinNoiseTextureSize)), glm::ivec3(1, gPerlinNoiseTextureSize, gPerlinNoiseTextureSize), [&](const Range3d& block)
 	{
+		const int s = block.begin.x;
 		for (int t = 0; t<gPerlinNoiseTextureSize; t++)
 		{
 			for (int r = 0; r<gPerlinNoiseTextureSize; r++)
@@ -51,12 +464,11 @@ int main (int argc, char *argv[])
 				noise *= 255.0f;
 
 				int addr = r*gPerlinNoiseTextureSize*gPerlinNoiseTextureSize + t*gPerlinNoiseTextureSize + s;
-				perlinNoiseTexels[addr] = unsigned char(noise);
+				perlinNoiseTexels[addr] = (unsigned char)(noise);
 
 			}
 		}
-	}
-	); // end parallel_for
+	}); // end ParallelFor3d
 	free(perlinNoiseTexels);
 
 	//
@@ -66,8 +478,9 @@ int main (int argc, char *argv[])
 	unsigned char* worleyNoiseTexels = (unsigned char*)malloc(gWorleyNoiseTextureSize*gWorleyNoiseTextureSize*gWorleyNoiseTextureSize * sizeof(unsigned char));
 
 	const glm::vec3 normFactWorley = glm::vec3(1.0f / float(gWorleyNoiseTextureSize));
-	parallel_for(int(0), int(gWorleyNoiseTextureSize), [&](int s) //for (int s = 0; s<giWorleyNoiseTextureSize; s++)
+	scheduler.ParallelFor3d(Range3d(glm::ivec3(0), glm::ivec3(gWorleyNoiseTextureSize)), glm::ivec3(1, gWorleyNoiseTextureSize, gWorleyNoiseTextureSize), [&](const Range3d& block)
 	{
+		const int s = block.begin.x;
 		for (int t = 0; t<gWorleyNoiseTextureSize; t++)
 		{
 			for (int r = 0; r<gWorleyNoiseTextureSize; r++)
@@ -79,11 +492,10 @@ int main (int argc, char *argv[])
 				noise *= 255.0f;
 
 				int addr = r*gWorleyNoiseTextureSize*gWorleyNoiseTextureSize + t*gWorleyNoiseTextureSize + s;
-				worleyNoiseTexels[addr] = unsigned char(noise);
+				worleyNoiseTexels[addr] = (unsigned char)(noise);
 			}
 		}
-	}
-	); // end parallel_for
+	}); // end ParallelFor3d
 	free(worleyNoiseTexels);
 	*/
 
@@ -93,259 +505,345 @@ int main (int argc, char *argv[])
 	// Generate cloud shape and erosion texture similarly GPU Pro 7 chapter II-4
 	//
 
-	// Frequence multiplicator. No boudary check etc. but fine for this small tool.
-	const float frequenceMul[6] = { 2.0f,8.0f,14.0f,20.0f,26.0f,32.0f };	// special weight for perling worley
-
-														// Cloud base shape (will be used to generate PerlingWorley noise in he shader)
-														// Note: all channels could be combined once here to reduce memory bandwith requirements.
-	int cloudBaseShapeTextureSize = 128;				// !!! If this is reduce, you hsould also reduce the number of frequency in the fmb noise  !!!
-	int cloudBaseShapeRowBytes = cloudBaseShapeTextureSize * sizeof(unsigned char) * 4;
-	int cloudBaseShapeSliceBytes = cloudBaseShapeRowBytes * cloudBaseShapeTextureSize;
-	int cloudBaseShapeVolumeBytes = cloudBaseShapeSliceBytes * cloudBaseShapeTextureSize;
-	unsigned char* cloudBaseShapeTexels = (unsigned char*)malloc(cloudBaseShapeVolumeBytes);
-	unsigned char* cloudBaseShapeTexelsPacked = (unsigned char*)malloc(cloudBaseShapeVolumeBytes);
-	parallel_for(int(0), int(cloudBaseShapeTextureSize), [&](int s) //for (int s = 0; s<gCloudBaseShapeTextureSize; s++)
+	NoiseChannelGraph channelGraph;
+	std::string channelError;
+	if (!(channelsFileName ? channelGraph.Load(channelsFileName, channelError) : channelGraph.Parse(defaultChannels, channelError)))
 	{
-		const glm::vec3 normFact = glm::vec3(1.0f / float(cloudBaseShapeTextureSize));
-		for (int t = 0; t<cloudBaseShapeTextureSize; t++)
+		printf("Invalid channels %s: %s\n", channelsFileName ? channelsFileName : "", channelError.c_str());
+		return 1;
+	}
+	if (!outputTags.empty())
+	{
+		channelGraph.SelectOutputs(outputTags);
+		if (channelGraph.GetVolumeCount() == 0)
 		{
-			for (int r = 0; r<cloudBaseShapeTextureSize; r++)
-			{
-				glm::vec3 coord = glm::vec3(s, t, r) * normFact;
-
-				// Perlin FBM noise
-				const int octaveCount = 3;
-				const float frequency = 8.0f;
-				float perlinNoise = Tileable3dNoise::PerlinNoise(coord, frequency, octaveCount);
-
-				float PerlinWorleyNoise = 0.0f;
-				{
-					const float cellCount = 4;
-					const float worleyNoise0 = (1.0f - Tileable3dNoise::WorleyNoise(coord, cellCount * frequenceMul[0]));
-					const float worleyNoise1 = (1.0f - Tileable3dNoise::WorleyNoise(coord, cellCount * frequenceMul[1]));
-					const float worleyNoise2 = (1.0f - Tileable3dNoise::WorleyNoise(coord, cellCount * frequenceMul[2]));
-					const float worleyNoise3 = (1.0f - Tileable3dNoise::WorleyNoise(coord, cellCount * frequenceMul[3]));
-					const float worleyNoise4 = (1.0f - Tileable3dNoise::WorleyNoise(coord, cellCount * frequenceMul[4]));
-					const float worleyNoise5 = (1.0f - Tileable3dNoise::WorleyNoise(coord, cellCount * frequenceMul[5]));	// half the frequency of texel, we should not go further (with cellCount = 32 and texture size = 64)
-
-					float worleyFBM = worleyNoise0*0.625f + worleyNoise1*0.25f + worleyNoise2*0.125f;
-
-					// Perlin Worley is based on description in GPU Pro 7: Real Time Volumetric Cloudscapes.
-					// However it is not clear the text and the image are matching: images does not seem to match what the result  from the description in text would give.
-					// Also there are a lot of fudge factor in the code, e.g. *0.2, so it is really up to you to fine the formula you like.
-					//PerlinWorleyNoise = remap(worleyFBM, 0.0, 1.0, 0.0, perlinNoise);	// Matches better what figure 4.7 (not the following up text description p.101). Maps worley between newMin as 0 and 
-					PerlinWorleyNoise = remap(perlinNoise, 0.0f, 1.0f, worleyFBM, 1.0f);	// mapping perlin noise in between worley as minimum and 1.0 as maximum (as described in text of p.101 of GPU Pro 7) 
-				}
-
-				const float cellCount = 4;
-				float worleyNoise0 = (1.0f - Tileable3dNoise::WorleyNoise(coord, cellCount * 1));
-				float worleyNoise1 = (1.0f - Tileable3dNoise::WorleyNoise(coord, cellCount * 2));
-				float worleyNoise2 = (1.0f - Tileable3dNoise::WorleyNoise(coord, cellCount * 4));
-				float worleyNoise3 = (1.0f - Tileable3dNoise::WorleyNoise(coord, cellCount * 8));
-				float worleyNoise4 = (1.0f - Tileable3dNoise::WorleyNoise(coord, cellCount * 16));
-				//float worleyNoise5 = (1.0f - Tileable3dNoise::WorleyNoise(coord, cellCount * 32));	//cellCount=2 -> half the frequency of texel, we should not go further (with cellCount = 32 and texture size = 64)
-
-				// Three frequency of Worley FBM noise
-				float worleyFBM0 = worleyNoise1*0.625f + worleyNoise2*0.25f + worleyNoise3*0.125f;
-				float worleyFBM1 = worleyNoise2*0.625f + worleyNoise3*0.25f + worleyNoise4*0.125f;
-				//float worleyFBM2 = worleyNoise3*0.625f + worleyNoise4*0.25f + worleyNoise5*0.125f;
-				float worleyFBM2 = worleyNoise3*0.75f + worleyNoise4*0.25f; // cellCount=4 -> worleyNoise5 is just noise due to sampling frequency=texel frequency. So only take into account 2 frequencies for FBM
-
-				int addr = r*cloudBaseShapeTextureSize*cloudBaseShapeTextureSize + t*cloudBaseShapeTextureSize + s;
-
-				addr *= 4;
-				cloudBaseShapeTexels[addr] = unsigned char(255.0f*PerlinWorleyNoise);
-				cloudBaseShapeTexels[addr + 1] = unsigned char(255.0f*worleyFBM0);
-				cloudBaseShapeTexels[addr + 2] = unsigned char(255.0f*worleyFBM1);
-				cloudBaseShapeTexels[addr + 3] = unsigned char(255.0f*worleyFBM2);
-
-				float value = 0.0;
-				{
-					// pack the channels for direct usage in shader
-					float lowFreqFBM = worleyFBM0*0.625f + worleyFBM1*0.25f + worleyFBM2*0.125f;
-					float baseCloud = PerlinWorleyNoise;
-					value = remap(baseCloud, -(1.0f - lowFreqFBM), 1.0f, 0.0f, 1.0f);
-					// Saturate
-					value = std::fminf(value, 1.0f);
-					value = std::fmaxf(value, 0.0f);
-				}
-				cloudBaseShapeTexelsPacked[addr] = unsigned char(255.0f*value);
-				cloudBaseShapeTexelsPacked[addr + 1] = unsigned char(255.0f*value);
-				cloudBaseShapeTexelsPacked[addr + 2] = unsigned char(255.0f*value);
-				cloudBaseShapeTexelsPacked[addr + 3] = unsigned char(255.0f);
-			}
+			printf("No output tagged with the -outputs selection\n");
+			return 1;
 		}
 	}
-	); // end parallel_for
+	if (!singleChannelTags.empty())
+		channelGraph.SingleChannelOutputs(singleChannelTags);
+	if (noiseMips)
+		channelGraph.AddMipVolumes();
+	NoiseChannelGraph::EvaluationOptions evaluationOptions;
+	evaluationOptions.nativePerlin = nativePerlin;
+	evaluationOptions.seed = seed;
+	evaluationOptions.quantization = quantization;
+
+	// Recorded in the header of the volume files
+	const char* const quantizationNames[] = { "truncate", "round", "dither" };
+	const std::string generatorParameters = std::string("channels=") + (channelsFileName ? channelsFileName : "default")
+		+ " hash=" + (Tileable3dNoise::GetHash() == Tileable3dNoise::Hash::Integer ? "integer" : "sin")
+		+ " seed=" + std::to_string(seed) + " perlin=" + (nativePerlin ? "native3d" : "glm4d")
+		+ " quantize=" + quantizationNames[int(quantization)] + (noiseMips ? " mips=noise" : "");
+
+	// The whole generation is a single task graph: the tasks of every volume, the ones reusing noise of an earlier volume
+	// waiting for the corresponding tasks of that volume, and the TGA writes of each window of z slices once complete.
+	// Files are written progressively, one window at a time: TGA for 8 bit outputs, OpenEXR for half and float ones, the
+	// texels only for outputs named *.raw, volume files for *.vol and archives for *.varc. TGA atlases are written by bands of a row of slices.
+	// Mip levels are either extra volumes of the graph (-mips noise) or filtered once the whole volume is written.
+	struct OutputFile
 	{
-		int width = cloudBaseShapeTextureSize*cloudBaseShapeTextureSize;
-		int height = cloudBaseShapeTextureSize;
-		writeTGA("noiseShape.tga",       width, height, cloudBaseShapeTexels);
-		writeTGA("noiseShapePacked.tga", width, height, cloudBaseShapeTexelsPacked);
-	}
-
-
-
-
-
-
-	// Detail texture behing different frequency of Worley noise
-	// Note: all channels could be combined once here to reduce memory bandwith requirements.
-	int cloudErosionTextureSize = 32;
-	int cloudErosionRowBytes = cloudErosionTextureSize * sizeof(unsigned char) * 4;
-	int cloudErosionSliceBytes = cloudErosionRowBytes * cloudErosionTextureSize;
-	int cloudErosionVolumeBytes = cloudErosionSliceBytes * cloudErosionTextureSize;
-	unsigned char* cloudErosionTexels = (unsigned char*)malloc(cloudErosionVolumeBytes);
-	unsigned char* cloudErosionTexelsPacked = (unsigned char*)malloc(cloudErosionVolumeBytes);
-	parallel_for(int(0), int(cloudErosionTextureSize), [&](int s) //for (int s = 0; s<gCloudErosionTextureSize; s++)
+		bool raw;
+		bool vol;
+		VolumeFile::Writer volFile;
+		bool archive;
+		VolumeArchive::Writer archiveFile;
+		FILE* rawFile;
+		void* tga;
+		ExrWriter exr;
+		bool failed;
+		int atlasColumns;								// 0 for the strip layout
+		int atlasSlices;								// slices of the band being filled
+		std::vector<unsigned char> atlasBand;
+		std::vector<unsigned char> atlasRows;
+		std::vector<std::vector<float>> mipSource;		// channels of the whole volume for the mip filters
+	};
+	// Set by any failed file write, the run then returns 1 once the task graph is done
+	std::atomic<bool> writeFailed(false);
+	// Scanlines of RLE files are encoded in parallel into separate buffers, then appended in order
+	auto writeTgaRows = [&](void* tga, int width, int rowCount, const unsigned char* pixels, unsigned int tgaFormat)
+	{
+		if (!rleTga)
+			return tga_write_raw_pixels(tga, width*rowCount, pixels, tgaFormat) != 0;
+		const size_t rowBytes = size_t(width) * (tgaFormat == TGA_GRAYSCALE_8 ? 1 : 4);
+		const size_t bound = size_t(tga_rle_bound(width, tgaFormat));
+		std::vector<unsigned char> packets(bound * rowCount);
+		std::vector<int> packetSizes(rowCount);
+		scheduler.ParallelFor3d(Range3d(glm::ivec3(0), glm::ivec3(1, 1, rowCount)), glm::ivec3(1, 1, 1), [&](const Range3d& block)
+		{
+			for (int row = block.begin.z; row < block.end.z; row++)
+				packetSizes[row] = tga_rle_encode(width, pixels + row * rowBytes, tgaFormat, &packets[row * bound]);
+		});
+		// tga_rle_encode returns 0 on error, a scanline always takes at least one packet
+		for (int row = 0; row < rowCount; row++)
+		{
+			if (packetSizes[row] == 0 || !tga_write_rle_packets(tga, packetSizes[row], &packets[row * bound]))
+				return false;
+		}
+		return true;
+	};
+	auto writeSlices = [&](OutputFile& file, const std::string& fileName, NoiseChannelGraph::OutputFormat format, int channelCount, int texelSize,
+		int size, int firstSlice, int sliceCount, const unsigned char* texels)
 	{
-		const glm::vec3 normFact = glm::vec3(1.0f / float(cloudErosionTextureSize));
-		for (int t = 0; t<cloudErosionTextureSize; t++)
+		const unsigned int tgaFormat = channelCount == 1 ? TGA_GRAYSCALE_8 : rgbaFormat;
+		if (firstSlice == 0)
 		{
-			for (int r = 0; r<cloudErosionTextureSize; r++)
+			file.raw = fileName.size() >= 4 && fileName.compare(fileName.size() - 4, 4, ".raw") == 0;
+			file.vol = fileName.size() >= 4 && fileName.compare(fileName.size() - 4, 4, ".vol") == 0;
+			file.archive = fileName.size() >= 5 && fileName.compare(fileName.size() - 5, 5, ".varc") == 0;
+			file.rawFile = nullptr;
+			file.tga = nullptr;
+			file.atlasColumns = 0;
+			if (file.raw)
+				file.failed = (file.rawFile = fopen(fileName.c_str(), "wb")) == nullptr;
+			else if (file.vol || file.archive)
 			{
-				glm::vec3 coord = glm::vec3(s, t, r) * normFact;
-
-#if 1
-				// 3 octaves
-				const float cellCount = 2;
-				float worleyNoise0 = (1.0f - Tileable3dNoise::WorleyNoise(coord, cellCount * 1));
-				float worleyNoise1 = (1.0f - Tileable3dNoise::WorleyNoise(coord, cellCount * 2));
-				float worleyNoise2 = (1.0f - Tileable3dNoise::WorleyNoise(coord, cellCount * 4));
-				float worleyNoise3 = (1.0f - Tileable3dNoise::WorleyNoise(coord, cellCount * 8));
-				float worleyFBM0 = worleyNoise0*0.625f + worleyNoise1*0.25f + worleyNoise2*0.125f;
-				float worleyFBM1 = worleyNoise1*0.625f + worleyNoise2*0.25f + worleyNoise3*0.125f;
-				float worleyFBM2 = worleyNoise2*0.75f + worleyNoise3*0.25f; // cellCount=4 -> worleyNoise4 is just noise due to sampling frequency=texel freque. So only take into account 2 frequencies for FBM
-#else
-				// 2 octaves
-				float worleyNoise0 = (1.0f - Tileable3dNoise::WorleyNoise(coord, 4));
-				float worleyNoise1 = (1.0f - Tileable3dNoise::WorleyNoise(coord, 7));
-				float worleyNoise2 = (1.0f - Tileable3dNoise::WorleyNoise(coord, 10));
-				float worleyNoise3 = (1.0f - Tileable3dNoise::WorleyNoise(coord, 13));
-				float worleyFBM0 = worleyNoise0*0.75f + worleyNoise1*0.25f;
-				float worleyFBM1 = worleyNoise1*0.75f + worleyNoise2*0.25f;
-				float worleyFBM2 = worleyNoise2*0.75f + worleyNoise3*0.25f;
-#endif
-
-				int addr = r*cloudErosionTextureSize*cloudErosionTextureSize + t*cloudErosionTextureSize + s;
-				addr *= 4;
-				cloudErosionTexels[addr] = unsigned char(255.0f*worleyFBM0);
-				cloudErosionTexels[addr + 1] = unsigned char(255.0f*worleyFBM1);
-				cloudErosionTexels[addr + 2] = unsigned char(255.0f*worleyFBM2);
-				cloudErosionTexels[addr + 3] = unsigned char(255.0f);
-
-				float value = 0.0;
-				{
-					value = worleyFBM0*0.625f + worleyFBM1*0.25f + worleyFBM2*0.125f;
-				}
-				cloudErosionTexelsPacked[addr] = unsigned char(255.0f * value);
-				cloudErosionTexelsPacked[addr + 1] = unsigned char(255.0f * value);
-				cloudErosionTexelsPacked[addr + 2] = unsigned char(255.0f * value);
-				cloudErosionTexelsPacked[addr + 3] = unsigned char(255.0f);
+				const VolumeFile::ElementType elementType = format == NoiseChannelGraph::OutputFormat::Unorm8 ? VolumeFile::ElementType::Unorm8
+					: format == NoiseChannelGraph::OutputFormat::Half ? VolumeFile::ElementType::Half : VolumeFile::ElementType::Float;
+				file.failed = file.vol ? !file.volFile.Begin(fileName.c_str(), size, channelCount, elementType, generatorParameters)
+					: !file.archiveFile.Begin(fileName.c_str(), size, channelCount, elementType, archiveBrickSize, archiveFilter, generatorParameters);
+			}
+			else if (format == NoiseChannelGraph::OutputFormat::Unorm8 && (atlasLayout || size*size > 0xFFFF))
+			{
+				// Near square grid of slices, slice z being at column z % columns and row z / columns from the bottom
+				int columns = 1;
+				while (columns * columns < size)
+					columns++;
+				const int rows = (size + columns - 1) / columns;
+				char id[64];
+				snprintf(id, sizeof(id), "volume atlas size=%d columns=%d rows=%d", size, columns, rows);
+				file.tga = rleTga ? tga_write_rle_begin_id(fileName.c_str(), columns*size, rows*size, tgaFormat, id)
+					: tga_write_raw_begin_id(fileName.c_str(), columns*size, rows*size, tgaFormat, id);
+				file.failed = file.tga == nullptr;
+				file.atlasColumns = columns;
+				file.atlasSlices = 0;
+				file.atlasBand.assign(size_t(columns) * size * size * texelSize, 0);
+				file.atlasRows.resize(file.atlasBand.size());
+			}
+			else if (format == NoiseChannelGraph::OutputFormat::Unorm8)
+			{
+				file.tga = rleTga ? tga_write_rle_begin(fileName.c_str(), size*size, size, tgaFormat) : tga_write_raw_begin(fileName.c_str(), size*size, size, tgaFormat);
+				file.failed = file.tga == nullptr;
+			}
+			else
+				file.failed = !file.exr.Begin(fileName.c_str(), size*size, size, channelCount,
+					format == NoiseChannelGraph::OutputFormat::Half ? ExrWriter::PixelType::Half : ExrWriter::PixelType::Float);
+			if (file.failed)
+			{
+				printf("Failed to write image!\n");
+				const bool tga = !file.raw && !file.vol && !file.archive && format == NoiseChannelGraph::OutputFormat::Unorm8;
+				printf("%s\n", tga ? tga_error_string(tga_get_last_error()) : fileName.c_str());
+				writeFailed = true;
 			}
 		}
-	}
-	); // end parallel_for
-	{
-		int width = cloudErosionTextureSize*cloudErosionTextureSize;
-		int height = cloudErosionTextureSize;
-		writeTGA("noiseErosion.tga",       width, height, cloudErosionTexels);
-		writeTGA("noiseErosionPacked.tga", width, height, cloudErosionTexelsPacked);
-	}
-
-#if 0
-	// Debug tileability using a 3x3 tile of the same slice, see if edges appears.
-
-	auto debugPrintTileability = [&](auto addrSrc2, auto addrDst2, const char* debugStr) 
-	{
-		for (int r = 0; r < cloudBaseShapeTextureSize; r += cloudBaseShapeTextureSize / 8)
+		if (file.failed)
+			return;
+		const bool last = firstSlice + sliceCount == size;
+		bool written = true;
+		if (file.raw)
 		{
-			unsigned char* debugImg = (unsigned char*)malloc(9 * cloudBaseShapeSliceBytes);
-			for (int i = 0; i < cloudBaseShapeTextureSize; i++)
+			written = fwrite(texels, size_t(texelSize) * size * size, sliceCount, file.rawFile) == size_t(sliceCount);
+			if (last)
+				written = fclose(file.rawFile) == 0 && written;
+		}
+		else if (file.vol)
+		{
+			written = file.volFile.WriteSlices(sliceCount, texels);
+			if (last)
+				written = file.volFile.End() && written;
+		}
+		else if (file.archive)
+		{
+			written = file.archiveFile.WriteSlices(scheduler, sliceCount, texels);
+			if (last)
+				written = file.archiveFile.End() && written;
+		}
+		else if (file.tga && file.atlasColumns > 0)
+		{
+			const size_t sliceBytes = size_t(size) * size * texelSize;
+			const size_t rowBytes = size_t(size) * texelSize;
+			for (int z = 0; z < sliceCount; z++)
 			{
-				int t = i;
-
-				// copy the row into the 9 debug texture tiles
-				auto addrSrc = [&]()
-				{
-					return addrSrc2(r, t, cloudBaseShapeSliceBytes, cloudBaseShapeRowBytes);
-				};
-				auto addrDst = [&](auto x, auto y)
-				{
-					return addrDst2(x, y, t, cloudBaseShapeSliceBytes, cloudBaseShapeRowBytes);
-				};
-
-				memcpy(debugImg + addrDst(0, 0), cloudBaseShapeTexelsPacked + addrSrc(), cloudBaseShapeRowBytes);
-				memcpy(debugImg + addrDst(1, 0), cloudBaseShapeTexelsPacked + addrSrc(), cloudBaseShapeRowBytes);
-				memcpy(debugImg + addrDst(2, 0), cloudBaseShapeTexelsPacked + addrSrc(), cloudBaseShapeRowBytes);
-				memcpy(debugImg + addrDst(0, 1), cloudBaseShapeTexelsPacked + addrSrc(), cloudBaseShapeRowBytes);
-				memcpy(debugImg + addrDst(1, 1), cloudBaseShapeTexelsPacked + addrSrc(), cloudBaseShapeRowBytes);
-				memcpy(debugImg + addrDst(2, 1), cloudBaseShapeTexelsPacked + addrSrc(), cloudBaseShapeRowBytes);
-				memcpy(debugImg + addrDst(0, 2), cloudBaseShapeTexelsPacked + addrSrc(), cloudBaseShapeRowBytes);
-				memcpy(debugImg + addrDst(1, 2), cloudBaseShapeTexelsPacked + addrSrc(), cloudBaseShapeRowBytes);
-				memcpy(debugImg + addrDst(2, 2), cloudBaseShapeTexelsPacked + addrSrc(), cloudBaseShapeRowBytes);
+				memcpy(&file.atlasBand[file.atlasSlices * sliceBytes], texels + z * sliceBytes, sliceBytes);
+				file.atlasSlices++;
+				if (file.atlasSlices < file.atlasColumns && firstSlice + z + 1 < size)
+					continue;
+
+				// Rows of the band go through all its slices, the slices missing from the last band are left black
+				for (int t = 0; t < size; t++)
+					for (int c = 0; c < file.atlasColumns; c++)
+						memcpy(&file.atlasRows[(size_t(t) * file.atlasColumns + c) * rowBytes], &file.atlasBand[c * sliceBytes + t * rowBytes], rowBytes);
+				written = written && writeTgaRows(file.tga, file.atlasColumns*size, size, file.atlasRows.data(), tgaFormat);
+				file.atlasSlices = 0;
+				std::fill(file.atlasBand.begin(), file.atlasBand.end(), (unsigned char)0);
+			}
+			if (last)
+				written = tga_write_raw_end(file.tga) && written;
+		}
+		else if (file.tga)
+		{
+			written = writeTgaRows(file.tga, size*size, sliceCount, texels, tgaFormat);
+			if (last)
+				written = tga_write_raw_end(file.tga) && written;
+		}
+		else
+		{
+			written = file.exr.WriteRows(sliceCount, texels);
+			if (last)
+				written = file.exr.End() && written;
+		}
+		if (!written)
+		{
+			printf("Failed to write %s\n", fileName.c_str());
+			file.failed = true;
+			writeFailed = true;
+		}
+	};
 
+	// Filtered mip levels of an output, computed from its whole volume once written. 8 bit levels are rounded to nearest
+	// since truncating the filtered values would darken them.
+	auto writeFilteredMips = [&](OutputFile& file, const std::string& fileName, NoiseChannelGraph::OutputFormat format, int channelCount, int texelSize, int size)
+	{
+		std::vector<std::vector<std::vector<float>>> levels(channelCount);
+		for (int c = 0; c < channelCount; c++)
+			VolumeMips::GenerateChain(scheduler, file.mipSource[c].data(), size, mipFilter, levels[c]);
+		file.mipSource.clear();
 
+		for (size_t k = 0; k < levels[0].size(); k++)
+		{
+			const int levelSize = size >> (k + 1);
+			const int count = levelSize * levelSize * levelSize;
+			const float* planes[4];
+			for (int c = 0; c < channelCount; c++)
+				planes[c] = levels[c][k].data();
+			std::vector<unsigned char> texels(size_t(count) * texelSize);
+			if (format == NoiseChannelGraph::OutputFormat::Unorm8)
+			{
+				Tileable3dNoise::QuantizeUnorm8Batch(planes, channelCount, count, nullptr, true, texels.data());
+			}
+			else
+			{
+				std::vector<float> interleaved(size_t(count) * channelCount);
+				for (int i = 0; i < count; i++)
+					for (int c = 0; c < channelCount; c++)
+						interleaved[size_t(i) * channelCount + c] = planes[c][i];
+				if (format == NoiseChannelGraph::OutputFormat::Half)
+					Tileable3dNoise::FloatToHalfBatch(interleaved.data(), (unsigned short*)texels.data(), count * channelCount);
+				else
+					memcpy(texels.data(), interleaved.data(), texels.size());
 			}
-			char fileName[256];
-			sprintf_s(fileName, 256, "debugBase%s%i.tga", debugStr, r);
-			writeTGA(fileName, cloudBaseShapeTextureSize * 3, cloudBaseShapeTextureSize * 3, debugImg);
+			OutputFile levelFile;
+			writeSlices(levelFile, VolumeMips::GetLevelFileName(fileName, int(k) + 1), format, channelCount, texelSize, levelSize, 0, levelSize, texels.data());
 		}
+	};
 
-		for (int r = 0; r < cloudErosionTextureSize; r += cloudErosionTextureSize / 8)
+	const int volumeCount = channelGraph.GetVolumeCount();
+	std::vector<std::vector<OutputFile>> outputFiles(volumeCount);
+	auto writeWindow = [&](int volume, int firstSlice, int sliceCount, const unsigned char* const* texels)
+	{
+		const int size = channelGraph.GetVolumeSize(volume);
+		const int outputCount = channelGraph.GetOutputCount(volume);
+		if (firstSlice == 0)
+			outputFiles[volume].resize(outputCount);
+		for (int o = 0; o < outputCount; o++)
 		{
-			unsigned char* debugImg = (unsigned char*)malloc(9*cloudErosionSliceBytes);
-			for (int i = 0; i < cloudErosionTextureSize; i++)
+			OutputFile& file = outputFiles[volume][o];
+			const std::string& fileName = channelGraph.GetOutputFileName(volume, o);
+			const int channelCount = channelGraph.GetOutputChannelCount(volume, o);
+			const NoiseChannelGraph::OutputFormat format = channelGraph.GetOutputFormat(volume, o);
+			const int texelSize = channelGraph.GetOutputTexelSize(volume, o);
+			writeSlices(file, fileName, format, channelCount, texelSize, size, firstSlice, sliceCount, texels[o]);
+
+			if (filterMips)
 			{
-				int t = i;
-
-				auto addrSrc = [&]()
+				const size_t first = size_t(firstSlice) * size * size;
+				const size_t count = size_t(sliceCount) * size * size;
+				file.mipSource.resize(channelCount);
+				for (int c = 0; c < channelCount; c++)
 				{
-					return addrSrc2(r, t, cloudErosionSliceBytes, cloudErosionRowBytes);
-				};
-				auto addrDst = [&](auto x, auto y)
+					std::vector<float>& plane = file.mipSource[c];
+					plane.resize(size_t(size) * size * size);
+					for (size_t i = 0; i < count; i++)
+					{
+						const size_t e = i * channelCount + c;
+						if (format == NoiseChannelGraph::OutputFormat::Unorm8)
+							plane[first + i] = float(texels[o][e]) / 255.0f;
+						else if (format == NoiseChannelGraph::OutputFormat::Half)
+							plane[first + i] = Tileable3dNoise::HalfToFloat(((const unsigned short*)texels[o])[e]);
+						else
+							plane[first + i] = ((const float*)texels[o])[e];
+					}
+				}
+				if (firstSlice + sliceCount == size)
+					writeFilteredMips(file, fileName, format, channelCount, texelSize, size);
+			}
+
+#if 0
+			// Debug tileability using a 3x3 tile of the same slice, see if edges appears.
+			if (sliceCount == size && channelCount == 4)
+			{
+				const size_t rowBytes = size_t(size) * 4;
+				const size_t sliceBytes = rowBytes * size;
+				for (int xz = 0; xz < 2; xz++)
 				{
-					return addrDst2(x, y, t, cloudErosionSliceBytes, cloudErosionRowBytes);
-				};
-
-				memcpy(debugImg + addrDst(0,0), cloudErosionTexelsPacked + addrSrc(), cloudErosionRowBytes);
-				memcpy(debugImg + addrDst(1,0), cloudErosionTexelsPacked + addrSrc(), cloudErosionRowBytes);
-				memcpy(debugImg + addrDst(2,0), cloudErosionTexelsPacked + addrSrc(), cloudErosionRowBytes);
-				memcpy(debugImg + addrDst(0,1), cloudErosionTexelsPacked + addrSrc(), cloudErosionRowBytes);
-				memcpy(debugImg + addrDst(1,1), cloudErosionTexelsPacked + addrSrc(), cloudErosionRowBytes);
-				memcpy(debugImg + addrDst(2,1), cloudErosionTexelsPacked + addrSrc(), cloudErosionRowBytes);
-				memcpy(debugImg + addrDst(0,2), cloudErosionTexelsPacked + addrSrc(), cloudErosionRowBytes);
-				memcpy(debugImg + addrDst(1,2), cloudErosionTexelsPacked + addrSrc(), cloudErosionRowBytes);
-				memcpy(debugImg + addrDst(2,2), cloudErosionTexelsPacked + addrSrc(), cloudErosionRowBytes);
+					for (int r = 0; r < size; r += size / 8)
+					{
+						unsigned char* debugImg = (unsigned char*)malloc(9 * sliceBytes);
+						for (int t = 0; t < size; t++)
+						{
+							// copy the row into the 9 debug texture tiles
+							const size_t addrSrc = xz ? t*sliceBytes + r*rowBytes : r*sliceBytes + t*rowBytes;
+							for (int y = 0; y < 3; y++)
+								for (int x = 0; x < 3; x++)
+									memcpy(debugImg + x * rowBytes + y * sliceBytes * 3 + t * rowBytes * 3, texels[o] + addrSrc, rowBytes);
+						}
+						char fileName[256];
+						snprintf(fileName, 256, "debug_%s_%s%i.tga", channelGraph.GetOutputFileName(volume, o).c_str(), xz ? "XZ" : "XY", r);
+						writeTGA(fileName, size * 3, size * 3, debugImg);
+						free(debugImg);
+					}
+				}
 			}
-			char fileName[256];
-			sprintf_s(fileName, 256, "debugErosion%s%i.tga", debugStr, r);
-			writeTGA(fileName, cloudErosionTextureSize*3, cloudErosionTextureSize*3, debugImg);
+#endif
 		}
 	};
 
-	auto addrDst = [](auto x, auto y, auto t, auto sliceBytes, auto rowBytes)
-	{
-		return x * rowBytes + y * sliceBytes * 3 + t * rowBytes * 3;
-	};
-	auto addrSrcXY = [](auto r, auto t, auto sliceBytes, auto rowBytes)
+	// The archive writers keep a row of bricks until it is complete and the mip filters the whole volume, out of the
+	// budget of the windows
+	if (memoryBudget > 0)
 	{
-		return r*sliceBytes + t*rowBytes;
-	};
-	auto addrSrcXZ = [](auto r, auto t, auto sliceBytes, auto rowBytes)
-	{
-		return t*sliceBytes + r*rowBytes;
-	};
-
-	debugPrintTileability(addrSrcXY, addrDst, "XY");
-	debugPrintTileability(addrSrcXZ, addrDst, "XZ");
-#endif
+		size_t writerBytes = 0;
+		for (int volume = 0; volume < volumeCount; volume++)
+			for (int o = 0; o < channelGraph.GetOutputCount(volume); o++)
+			{
+				const std::string& fileName = channelGraph.GetOutputFileName(volume, o);
+				const int size = channelGraph.GetVolumeSize(volume);
+				if (fileName.size() >= 5 && fileName.compare(fileName.size() - 5, 5, ".varc") == 0)
+					writerBytes += VolumeArchive::Writer::GetSlabSize(size, channelGraph.GetOutputTexelSize(volume, o), archiveBrickSize);
+				if (filterMips)
+					writerBytes += VolumeMips::GetChainMemorySize(size, channelGraph.GetOutputChannelCount(volume, o));
+			}
+		// The windows still get at least one slice when the writers take the whole budget
+		if (writerBytes >= memoryBudget)
+			printf("The file writers alone need %.1f MiB, over the memory budget\n", double(writerBytes) / (1024.0 * 1024.0));
+		memoryBudget = memoryBudget > writerBytes ? memoryBudget - writerBytes : 1;
+	}
 
-	free(cloudErosionTexels);
-	free(cloudErosionTexelsPacked);
-	free(cloudBaseShapeTexels);
-	free(cloudBaseShapeTexelsPacked);
+	TaskGraph taskGraph;
+	std::vector<int> volumeTasks;
+	channelGraph.AddTasks(taskGraph, taskSplit, scheduler.GetThreadCount(), memoryBudget, evaluationOptions, writeWindow, volumeTasks);
+	const TaskTimings timings = scheduler.Run(taskGraph);
+	if (printTimings)
+	{
+		for (int volume = 0; volume < volumeCount; volume++)
+		{
+			printf("Volume %s: %d noise evaluated and %d reused from previous volumes out of %d declared\n", channelGraph.GetVolumeName(volume).c_str(),
+				channelGraph.GetEvaluatedNoiseCount(volume), channelGraph.GetSharedNoiseCount(volume), channelGraph.GetDeclaredNoiseCount(volume));
+		}
+		timings.Print("Volumes and TGA writes");
+	}
 
-    return 0;
+    return writeFailed ? 1 : 0;
 }
 